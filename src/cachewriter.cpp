@@ -0,0 +1,152 @@
+#include <QDateTime>
+#include <QElapsedTimer>
+#include "cachewriter.h"
+#include "db.h"
+#include "video.h"
+
+CacheWriter &CacheWriter::instance()
+{
+    static CacheWriter writer;
+    return writer;
+}
+
+void CacheWriter::writeMetadata(const Video &video)
+{
+    const QVariantList row = Db::metadataRow(video);
+    enqueue([row](const Db &cache) { cache.writeMetadata(row); });
+}
+
+void CacheWriter::writeCapture(const QString &id, const int &percent, const bool &keyframes, const QByteArray &image)
+{
+    enqueue([id, percent, keyframes, image](const Db &cache) { cache.writeCapture(id, percent, keyframes, image); });
+}
+
+void CacheWriter::writeFingerprint(const Video &video, const int &mode)
+{
+    const QVariantList row = Db::fingerprintRow(video, mode);
+    const QString id = video.id;
+    const QByteArray thumbnail = video.thumbnail;
+    enqueue([this, row, id, thumbnail](const Db &cache)
+    {
+        if(cache.writeFingerprint(row))
+            _uncommittedThumbnails.insert(id, thumbnail);       //until transaction is committed too
+        else
+        {
+            QMutexLocker locker(&_mutex);
+            _unwrittenThumbnails.insert(id, thumbnail);
+        }
+    });
+}
+
+QByteArray CacheWriter::unwrittenThumbnail(const QString &id)
+{
+    QMutexLocker locker(&_mutex);
+    return _unwrittenThumbnails.value(id);
+}
+
+void CacheWriter::writeAccessTime(const QVector<Video *> &videos)
+{
+    const int64_t now = QDateTime::currentSecsSinceEpoch();
+    QVector<QString> ids;
+    QVector<QString> filenames;
+    for(const auto &video : videos)
+    {
+        ids << video->id;
+        filenames << video->filename;
+    }
+    enqueue([ids, filenames, now](const Db &cache) { cache.writeAccessTime(ids, filenames, now); });
+}
+
+void CacheWriter::writePath(const QVariantList &row)
+{
+    enqueue([row](const Db &cache) { cache.writePath(row); });
+}
+
+void CacheWriter::writeDirectory(const QVariantList &row)
+{
+    enqueue([row](const Db &cache) { cache.writeDirectory(row); });
+}
+
+void CacheWriter::enqueue(const std::function<void(const Db &)> &write)
+{
+    QMutexLocker locker(&_mutex);
+    while(_queue.count() >= _maxQueued)
+        _notFull.wait(&_mutex);
+
+    _queue.enqueue(write);
+    if(_queue.count() == 1 || _queue.count() >= _transactionSize)
+        _batchReady.wakeOne();
+    if(!isRunning() && !_stopping)
+        start(QThread::LowPriority);
+}
+
+void CacheWriter::flush()
+{
+    QMutexLocker locker(&_mutex);
+    _flushing = true;
+    _batchReady.wakeOne();
+    while(isRunning() && (!_queue.isEmpty() || _writing))
+        _idle.wait(&_mutex);
+    _flushing = false;
+}
+
+void CacheWriter::stop()
+{
+    {
+        QMutexLocker locker(&_mutex);
+        _stopping = true;
+        _batchReady.wakeOne();
+    }
+    wait();
+    _stopping = false;
+}
+
+void CacheWriter::run()
+{
+    Db cache(QStringLiteral("cachewriter"));
+    QElapsedTimer sinceCommit;
+
+    forever
+    {
+        QVector<std::function<void(const Db &)>> writes;
+        {
+            QMutexLocker locker(&_mutex);
+            while(_queue.isEmpty() && !_stopping)
+                _batchReady.wait(&_mutex);                      //sleep until there is something to write
+            sinceCommit.start();
+            while(_queue.count() < _transactionSize && !_flushing && !_stopping &&
+                  sinceCommit.elapsed() < _commitIntervalMs)
+                _batchReady.wait(&_mutex, static_cast<unsigned long>(_commitIntervalMs - sinceCommit.elapsed()));
+
+            if(_queue.isEmpty() && _stopping)
+                return;
+            while(!_queue.isEmpty() && writes.count() < _transactionSize)
+                writes << _queue.dequeue();
+            _writing = writes.count();
+            _notFull.wakeAll();
+        }
+
+        bool committed = writes.isEmpty();
+        for(int attempt=0; attempt<_commitAttempts && !committed; attempt++)
+        {                                                       //database may be locked by cache clean up
+            _uncommittedThumbnails.clear();
+            cache.transaction();
+            for(const auto &write : std::as_const(writes))
+                write(cache);
+            committed = cache.commit();
+            if(!committed)
+                cache.rollback();
+        }
+        if(!committed)
+        {
+            QMutexLocker locker(&_mutex);
+            _unwrittenThumbnails.insert(_uncommittedThumbnails);
+        }
+        _uncommittedThumbnails.clear();
+
+        QMutexLocker locker(&_mutex);
+        _writing = 0;
+        if(_queue.isEmpty())
+            _idle.wakeAll();
+    }
+}
@@ -0,0 +1,61 @@
+#ifndef CACHEWRITER_H
+#define CACHEWRITER_H
+
+#include <QThread>
+#include <QMutex>
+#include <QQueue>
+#include <QHash>
+#include <QWaitCondition>
+#include <functional>
+
+class Db;
+class Video;
+
+//all cache writes go through one thread and connection, which commits them in large transactions.
+//worker threads only copy the values to be written into a bounded queue, and never wait for the database
+class CacheWriter : public QThread
+{
+public:
+    static CacheWriter &instance();
+    ~CacheWriter() { stop(); }
+
+    void writeMetadata(const Video &video);
+    void writeCapture(const QString &id, const int &percent, const bool &keyframes, const QByteArray &image);
+    void writeFingerprint(const Video &video, const int &mode);
+    void writeAccessTime(const QVector<Video *> &videos);
+    void writePath(const QVariantList &row);
+    void writeDirectory(const QVariantList &row);
+
+    //GUI thumbnail of a fingerprint that could not be written (read-only folder, disk full), empty if there is none.
+    //videos don't keep their thumbnail after handing it to writer, so it is kept here instead of being lost
+    QByteArray unwrittenThumbnail(const QString &id);
+
+    //returns when everything queued so far is committed
+    void flush();
+
+    //commits everything queued and ends thread
+    void stop();
+
+private:
+    CacheWriter() = default;
+    void run();
+    void enqueue(const std::function<void(const Db &)> &write);
+
+    static constexpr int _maxQueued        = 5000;      //writers wait if queue is full (back-pressure)
+    static constexpr int _transactionSize  = 1000;      //commit after this many writes...
+    static constexpr int _commitIntervalMs = 2000;      //...or after this long, whichever comes first
+    static constexpr int _commitAttempts   = 2;         //failed transaction is rolled back and written once more
+
+    QMutex _mutex;
+    QWaitCondition _notFull;
+    QWaitCondition _batchReady;
+    QWaitCondition _idle;
+    QQueue<std::function<void(const Db &)>> _queue;
+    QHash<QString, QByteArray> _uncommittedThumbnails;      //only used by writer thread
+    QHash<QString, QByteArray> _unwrittenThumbnails;
+    int _writing = 0;
+    bool _flushing = false;
+    bool _stopping = false;
+};
+
+#endif // CACHEWRITER_H
@@ -1,11 +1,19 @@
+#include <QEventLoop>
 #include <QMessageBox>
+#include <QPainter>
+#include <QProgressDialog>
+#include <QTimer>
 #include <QWheelEvent>
+#include <atomic>
+#include "cachewriter.h"
 #include "comparison.h"
 #include "mainwindow.h"
 #include "ui_comparison.h"
 
-Comparison::Comparison(const QVector<Video *> &videosParam, const Prefs &prefsParam) :
-    QDialog(prefsParam._mainwPtr, Qt::Window), _videos(videosParam), _prefs(prefsParam)
+Comparison::Comparison(const QVector<Video *> &videosParam, const FingerprintStore &storeParam,
+                       const int &fingerprintModeParam, const Prefs &prefsParam) :
+    QDialog(prefsParam._mainwPtr, Qt::Window), _videos(videosParam), _prefs(prefsParam), _matcher(_prefs),
+    _store(storeParam), _fingerprintMode(fingerprintModeParam), _index(_store)
 {
     ui = new Ui::Comparison;
     ui->setupUi(this);
@@ -19,13 +27,23 @@ Comparison::Comparison(const QVector<Video *> &videosParam, const Prefs &prefsPa
         ui->selectSSIM->setChecked(true);
     ui->thresholdSlider->setValue(QVariant(_prefs._thresholdSSIM * 100).toInt());
     ui->thresholdSliderMax->setValue(QVariant(_prefs._thresholdSSIMMax * 100).toInt());
-    ui->progressBar->setMaximum(_prefs._numberOfVideos * (_prefs._numberOfVideos - 1) / 2);
+    ui->progressBar->setMaximum(_progressSteps);
 
-    on_nextVideo_clicked();
+    _prefetchPool.setMaxThreadCount(2);
+    _removed.fill(false, _videos.count());
+    if(filterMatches())
+        on_nextVideo_clicked();
+    else
+    {
+        emit sendStatusMessage(QStringLiteral("\nFinding matching videos was cancelled"));
+        QApplication::postEvent(this, new QKeyEvent(QEvent::KeyPress, Qt::Key_Escape, Qt::NoModifier));
+    }
 }
 
 Comparison::~Comparison()
 {
+    _prefetchPool.clear();                          //running prefetches only post results, which are dropped
+    _prefetchPool.waitForDone();
     delete ui;
 }
 
@@ -33,22 +51,130 @@ void Comparison::reportMatchingVideos()
 {
     int64_t combinedFilesize = 0;
     int foundMatches = 0;
+    int previousLeft = -1;
 
-    QVector<Video*>::const_iterator left, right, end = _videos.cend();
-    for(left=_videos.cbegin(); left<end; ++left)
-        for(right=left+1; right<end; ++right)
-            if(bothVideosMatch(*left, *right))
-            {   //smaller of two matching videos is likely the one to be deleted
-                combinedFilesize += std::min((*left)->size , (*right)->size);
-                foundMatches++;
-                break;
-            }
+    for(const auto &position : std::as_const(_matches))
+    {
+        const ScoredPair &match = _scored[position];
+        if(match.left != previousLeft)              //smaller of first matching pair is likely the one to be deleted
+        {
+            combinedFilesize += std::min(_videos[match.left]->size , _videos[match.right]->size);
+            foundMatches++;
+            previousLeft = match.left;
+        }
+    }
 
     if(foundMatches)
         emit sendStatusMessage(QStringLiteral("\n[%1] Found %2 video(s) (%3) with one or more matches")
              .arg(QTime::currentTime().toString()).arg(foundMatches).arg(readableFileSize(combinedFilesize)));
 }
 
+bool Comparison::scorePairs()
+{
+    const bool phash = _prefs._comparisonMode == _prefs._PHASH;
+    const int scoredPhash = qMax(phash? 0 : Matcher::_ssimMinPhash, _matcher.minPhashSimilarity() - _scoreMargin);
+    const int maxDistance = _matcher.maxPhashDistance(scoredPhash);
+    //with several hashes per video, SSIM of hashes below matching pHash floor must not count, as in Matcher::compare().
+    //with one hash, a pair below floor doesn't match anyway
+    const int ssimPhash = _store.hashesPerVideo() > 1? _matcher.minPhashSimilarity() : scoredPhash;
+    QVector<QVector<ScoredPair>> tiles((_videos.count() + _tileSize - 1) / _tileSize);
+    if(tiles.isEmpty())
+        return false;
+
+    QProgressDialog progress(QStringLiteral("Finding matching videos..."), QStringLiteral("Cancel"),
+                             0, static_cast<int>(_videos.count()), this);
+    progress.setWindowModality(Qt::ApplicationModal);   //window stays responsive, but pairs can't change meanwhile
+    progress.setMinimumDuration(_scoringDialogDelayMs);
+    std::atomic<int> videosDone(0);
+    std::atomic<int> tilesDone(0);
+    std::atomic<bool> cancelled(false);
+    QEventLoop waitForScoring;
+    connect(&progress, &QProgressDialog::canceled, &waitForScoring, [&cancelled]() { cancelled = true; });
+
+    QTimer refresh;
+    connect(&refresh, &QTimer::timeout, &progress, [&progress, &videosDone]() { progress.setValue(videosDone); });
+    refresh.start(_scoringProgressMs);
+
+    QThreadPool pool;
+    pool.setMaxThreadCount(QThread::idealThreadCount());
+    for(int t=0; t<tiles.count(); t++)              //first tiles have most comparisons, so they start first
+        pool.start([&, t]()
+        {
+            for(int left=t*_tileSize; left<qMin((t+1)*_tileSize, static_cast<int>(_videos.count())) && !cancelled;
+                left++, videosDone++)
+                for(const auto &right : _index.candidates(left, maxDistance))   //only similar enough pHashes
+                {
+                    const MatchScore score = _matcher.score(_store, left, right, ssimPhash);
+                    if(score.phash >= scoredPhash)
+                        tiles[t] << ScoredPair { left, right, score.phash, static_cast<float>(score.ssim) };
+                }
+            if(++tilesDone == tiles.count())
+                QMetaObject::invokeMethod(&waitForScoring, &QEventLoop::quit, Qt::QueuedConnection);
+        });
+    waitForScoring.exec();                          //pairs are scored in other threads, GUI only shows progress
+    pool.waitForDone();
+    refresh.stop();
+    if(cancelled)
+        return false;                               //pairs scored before are kept
+
+    _scoredMode = _prefs._comparisonMode;
+    _scoredPhash = scoredPhash;
+    _scoredSsimPhash = ssimPhash;
+    _scored.clear();
+    for(const auto &tile : std::as_const(tiles))
+        _scored << tile;
+    std::sort(_scored.begin(), _scored.end(), [phash](const ScoredPair &a, const ScoredPair &b)
+    {
+        if(phash && a.phash != b.phash)
+            return a.phash > b.phash;
+        if(!phash && a.ssim != b.ssim)
+            return a.ssim > b.ssim;
+        return std::make_pair(a.left, a.right) < std::make_pair(b.left, b.right);   //same order every time
+    });
+
+    QVector<int> counts(101, 0);
+    for(const auto &pair : std::as_const(_scored))
+        counts[phash? qRound(pair.phash * 100 / 64.0) : qBound(0, qRound(pair.ssim * 100), 100)]++;
+    ui->histogram->setCounts(counts, phash? qRound(_scoredPhash * 100 / 64.0) : 0);
+    return true;
+}
+
+bool Comparison::filterMatches()
+{
+    const bool ssimFloorMoved = _prefs._comparisonMode == _prefs._SSIM && _store.hashesPerVideo() > 1 &&
+                                _matcher.minPhashSimilarity() != _scoredSsimPhash;
+    if(_prefs._comparisonMode != _scoredMode || _matcher.minPhashSimilarity() < _scoredPhash || ssimFloorMoved)
+        if(!scorePairs() && _prefs._comparisonMode != _scoredMode)  //thresholds lowered past scored pairs
+        {
+            if(_scoredMode == -1)
+                return false;                       //cancelled before any pairs were scored
+            _prefs._comparisonMode = _scoredMode;   //cancelled: back to mode of scored pairs
+            _scoredMode == _prefs._PHASH? ui->selectPhash->setChecked(true) : ui->selectSSIM->setChecked(true);
+            emit switchComparisonMode(_prefs._comparisonMode);
+        }
+
+    const bool phash = _prefs._comparisonMode == _prefs._PHASH;
+    const auto first = std::partition_point(_scored.cbegin(), _scored.cend(), [&](const ScoredPair &pair)
+                       { return phash? pair.phash > _prefs._thresholdPhashMax : pair.ssim > _prefs._thresholdSSIMMax; });
+    const auto last = std::partition_point(first, _scored.cend(), [&](const ScoredPair &pair)
+                      { return phash? pair.phash >= _prefs._thresholdPhash : pair.ssim > _prefs._thresholdSSIM; });
+    _matches.clear();
+    for(auto pair=first; pair!=last; ++pair)       //SSIM mode: pHash must be similar enough too
+        if(_matcher.matches(MatchScore { false, pair->phash, pair->ssim }))
+            _matches << static_cast<int>(pair - _scored.cbegin());
+    std::sort(_matches.begin(), _matches.end(), [this](const int &a, const int &b)
+    { return std::make_pair(_scored[a].left, _scored[a].right) < std::make_pair(_scored[b].left, _scored[b].right); });
+    _matchesOutdated = false;
+    ui->histogram->setToolTip(QStringLiteral("Pairs at each similarity, %1 of %2 within thresholds")
+                              .arg(_matches.count()).arg(_scored.count()));
+
+    const auto after = std::upper_bound(_matches.cbegin(), _matches.cend(), std::make_pair(_leftVideo, _rightVideo),
+                       [this](const std::pair<int, int> &pair, const int &position)
+                       { return pair < std::make_pair(_scored[position].left, _scored[position].right); });
+    _match = static_cast<int>(after - _matches.cbegin()) - 1;      //pair shown or last one before it
+    return true;
+}
+
 void Comparison::confirmToExit()
 {
     int confirm = QMessageBox::Yes;
@@ -82,104 +208,56 @@ void Comparison::confirmToExit()
 void Comparison::on_prevVideo_clicked()
 {
     _seekForwards = false;
-    QVector<Video*>::const_iterator left, right, begin = _videos.cbegin();
-    for(_rightVideo--, left=begin+_leftVideo; left>=begin; --left, _leftVideo--)
-    {
-        for(right=begin+_rightVideo; right>left; --right, _rightVideo--)
-            if(bothVideosMatch(*left, *right) && QFileInfo::exists((*left)->filename) && QFileInfo::exists((*right)->filename))
-            {
-                showVideo(QStringLiteral("left"));
-                showVideo(QStringLiteral("right"));
-                highlightBetterProperties();
-                updateUI();
-                return;
-            }
-        ui->progressBar->setValue(comparisonsSoFar());
-        _rightVideo = _prefs._numberOfVideos - 1;
-    }
-
-    on_nextVideo_clicked();     //went over limit, go forwards until first match
+    if(_matchesOutdated)
+        filterMatches();
+
+    int position = _match;
+    if(position >= 0 && _scored[_matches[position]].left == _leftVideo &&
+                        _scored[_matches[position]].right == _rightVideo)
+        position--;
+    for(; position>=0; position--)
+        if(showMatch(position))
+            return;
+
+    _match = -1;                //went over limit, go forwards until first match
+    on_nextVideo_clicked();
 }
 
 void Comparison::on_nextVideo_clicked()
 {
     _seekForwards = true;
-    const int oldLeft = _leftVideo;
-    const int oldRight = _rightVideo;
+    if(_matchesOutdated)
+        filterMatches();
 
-    QVector<Video*>::const_iterator left, right, begin = _videos.cbegin(), end = _videos.cend();
-    for(left=begin+_leftVideo; left<end; ++left, _leftVideo++)
-    {
-        for(_rightVideo++, right=begin+_rightVideo; right<end; ++right, _rightVideo++)
-            if(bothVideosMatch(*left, *right) && QFileInfo::exists((*left)->filename) && QFileInfo::exists((*right)->filename))
-            {
-                showVideo(QStringLiteral("left"));
-                showVideo(QStringLiteral("right"));
-                highlightBetterProperties();
-                updateUI();
-                return;
-            }
-        ui->progressBar->setValue(comparisonsSoFar());
-        _rightVideo = _leftVideo + 1;
-    }
+    for(int position=_match+1; position<_matches.count(); position++)
+        if(showMatch(position))
+            return;
 
-    _leftVideo = oldLeft;       //went over limit, go to last matching pair
-    _rightVideo = oldRight;
-    confirmToExit();
+    confirmToExit();            //went over limit, last matching pair stays
 }
 
-bool Comparison::bothVideosMatch(const Video *left, const Video *right)
+bool Comparison::showMatch(const int &position)
 {
-    bool theyMatch = false;
-    _phashSimilarity = 0;
-
-    const int hashes = _prefs._thumbnails == cutEnds? 16 : 1;
-    for(int left_hash=0; left_hash<hashes; left_hash++)
-    {                               //if cutEnds mode: similarity is always the best one of both comparisons
-        for(int right_hash=0; right_hash<hashes; right_hash++)
+    const ScoredPair &match = _scored[_matches[position]];
+    if(_removed[match.left] || _removed[match.right])
+        return false;
+    for(const auto &video : {match.left, match.right})
+        if(!QFileInfo::exists(_videos[video]->filename))
         {
-            _phashSimilarity = qMax( _phashSimilarity, phashSimilarity(left, right, left_hash, right_hash));
-            if(_prefs._comparisonMode == _prefs._PHASH)
-            {
-                if(_phashSimilarity >= _prefs._thresholdPhash && _phashSimilarity <= _prefs._thresholdPhashMax )
-                    theyMatch = true;
-            }                           //ssim comparison is slow, only do it if pHash differs at most 20 bits of 64
-            else if(_phashSimilarity >= qMax(_prefs._thresholdPhash, 44))
-            {
-                _ssimSimilarity = ssim(left->grayThumb[left_hash], right->grayThumb[right_hash], _prefs._ssimBlockSize);
-                _ssimSimilarity = _ssimSimilarity + _durationModifier / 64.0;   // b/64 bits (phash) <=> p/100 % (ssim)
-                if(_ssimSimilarity > _prefs._thresholdSSIM && _ssimSimilarity <= _prefs._thresholdSSIMMax)
-                    theyMatch = true;
-            }
-            if(theyMatch)               //if cutEnds mode: first comparison matched already, skip second
-                break;
+            _removed[video] = true;                 //deleted outside of vidupe
+            return false;
         }
-        if(theyMatch)               //if cutEnds mode: first comparison matched already, skip second
-            break;
-    }
-    return theyMatch;
-}
-
-int Comparison::phashSimilarity(const Video *left, const Video *right, const int &leftHash, const int &rightHash)
-{
-    if(left->hash[leftHash] == 0 && right->hash[rightHash] == 0)
-        return 0;
-
-    int distance = 64;
-    uint64_t differentBits = left->hash[leftHash] ^ right->hash[rightHash];    //XOR to value (only ones for differing bits)
-    while(differentBits)
-    {
-        differentBits &= differentBits - 1;                 //count number of bits of value
-        distance--;
-    }
-
-    if( qAbs(left->duration - right->duration) <= 1000 )
-        _durationModifier = 0 + _prefs._sameDurationModifier;               //lower distance if both durations within 1s
-    else
-        _durationModifier = 0 - _prefs._differentDurationModifier;          //raise distance if both durations differ 1s
 
-    distance = distance + _durationModifier;
-    return distance > 64? 64 : distance;
+    _match = position;
+    _leftVideo = match.left;
+    _rightVideo = match.right;
+    _score = MatchScore { true, match.phash, match.ssim };
+    showVideo(QStringLiteral("left"));
+    showVideo(QStringLiteral("right"));
+    highlightBetterProperties();
+    updateUI();
+    prefetch();
+    return true;
 }
 
 void Comparison::showVideo(const QString &side) const
@@ -189,10 +267,7 @@ void Comparison::showVideo(const QString &side) const
         thisVideo = _rightVideo;
 
     auto *Image = this->findChild<ClickableLabel *>(side + QStringLiteral("Image"));
-    QBuffer pixels(&_videos[thisVideo]->thumbnail);
-    QImage image;
-    image.load(&pixels, QByteArrayLiteral("JPG"));
-    Image->setPixmap(QPixmap::fromImage(image).scaled(Image->width(), Image->height(), Qt::KeepAspectRatio));
+    Image->setPixmap(pixmap(thisVideo, Image->size()));
 
     auto *FileName = this->findChild<ClickableLabel *>(side + QStringLiteral("FileName"));
     FileName->setText(QFileInfo(_videos[thisVideo]->filename).fileName());
@@ -234,6 +309,74 @@ void Comparison::showVideo(const QString &side) const
     Audio->setText(_videos[thisVideo]->audio);
 }
 
+QImage Comparison::loadThumbnail(const QString &id, const int &mode)
+{
+    QByteArray jpeg = Db::forThread().readThumbnail(id, mode);
+    if(jpeg.isEmpty())
+        jpeg = CacheWriter::instance().unwrittenThumbnail(id);
+    QImage image;
+    image.loadFromData(jpeg, "JPG");
+    return image;
+}
+
+QImage Comparison::image(const int &video) const
+{
+    const QString &id = _videos[video]->id;
+    if(const QImage *cached = _images.object(id))
+        return *cached;
+
+    const QImage image = loadThumbnail(id, _fingerprintMode);
+    _images.insert(id, new QImage(image), qMax(1, static_cast<int>(image.sizeInBytes())));
+    return image;
+}
+
+QPixmap Comparison::pixmap(const int &video, const QSize &size) const
+{
+    const QString &id = _videos[video]->id;
+    const ScaledPixmap *cached = _pixmaps.object(id);
+    if(cached && cached->size == size)
+        return cached->pixmap;
+
+    const QPixmap scaled = QPixmap::fromImage(image(video).scaled(size, Qt::KeepAspectRatio));
+    _pixmaps.insert(id, new ScaledPixmap { size, scaled });     //replaces pixmap of previous size when resizing
+    return scaled;
+}
+
+void Comparison::prefetch()
+{
+    const int step = _seekForwards? 1 : -1;
+    int pairs = 0;
+    for(int position=_match+step; position>=0 && position<_matches.count() && pairs<_prefetchPairs; position+=step)
+    {
+        const ScoredPair &pair = _scored[_matches[position]];
+        if(_removed[pair.left] || _removed[pair.right])
+            continue;
+        prefetchImage(pair.left);
+        prefetchImage(pair.right);
+        pairs++;
+    }
+}
+
+void Comparison::prefetchImage(const int &video)
+{
+    const QString id = _videos[video]->id;
+    if(_images.contains(id) || _prefetching.contains(id))
+        return;
+
+    _prefetching.insert(id);
+    const int mode = _fingerprintMode;
+    _prefetchPool.start([this, id, mode]()
+    {
+        const QImage image = loadThumbnail(id, mode);
+        QMetaObject::invokeMethod(this, [this, id, image]()     //caches are only used in GUI thread
+        {
+            _prefetching.remove(id);
+            if(!_images.contains(id))
+                _images.insert(id, new QImage(image), qMax(1, static_cast<int>(image.sizeInBytes())));
+        }, Qt::QueuedConnection);
+    });
+}
+
 QString Comparison::readableDuration(const int64_t &milliseconds) const
 {
     if(milliseconds == 0)
@@ -364,22 +507,28 @@ void Comparison::updateUI()
     }
 
     if(_prefs._comparisonMode == _prefs._PHASH)
-        ui->identicalBits->setText(QString("%1/64 same bits").arg(_phashSimilarity));
+        ui->identicalBits->setText(QString("%1/64 same bits").arg(_score.phash));
     if(_prefs._comparisonMode == _prefs._SSIM)
-        ui->identicalBits->setText(QString("%1 SSIM index").arg(QString::number(qMin(_ssimSimilarity, 1.0), 'f', 3)));
+        ui->identicalBits->setText(QString("%1 SSIM index").arg(QString::number(qMin(_score.ssim, 1.0), 'f', 3)));
     _zoomLevel = 0;
-    ui->progressBar->setValue(comparisonsSoFar());
+    ui->progressBar->setValue(progress());
 }
 
-int Comparison::comparisonsSoFar() const
+int64_t Comparison::comparisonsSoFar() const
 {
-    const int cmpFirst = _prefs._numberOfVideos;                    //comparisons done for first video
-    const int cmpThis = cmpFirst - _leftVideo;                      //comparisons done for current video
-    const int remaining = cmpThis * (cmpThis - 1) / 2;              //comparisons for remaining videos
-    const int maxComparisons = cmpFirst * (cmpFirst - 1) / 2;       //comparing all videos with each other
+    const int64_t cmpFirst = _prefs._numberOfVideos;                //comparisons done for first video
+    const int64_t cmpThis = cmpFirst - _leftVideo;                  //comparisons done for current video
+    const int64_t remaining = cmpThis * (cmpThis - 1) / 2;          //comparisons for remaining videos
+    const int64_t maxComparisons = cmpFirst * (cmpFirst - 1) / 2;   //comparing all videos with each other
     return maxComparisons - remaining + _rightVideo - _leftVideo;
 }
 
+int Comparison::progress() const
+{
+    const int64_t maxComparisons = static_cast<int64_t>(_prefs._numberOfVideos) * (_prefs._numberOfVideos - 1) / 2;
+    return maxComparisons? static_cast<int>(comparisonsSoFar() * _progressSteps / maxComparisons) : 0;
+}
+
 void Comparison::openFileManager(const QString &filename) const
 {
     #if defined(Q_OS_WIN)
@@ -397,11 +546,12 @@ void Comparison::deleteVideo(const int &side)
 {
     const QString filename = _videos[side]->filename;
     const QString onlyFilename = filename.right(filename.length() - filename.lastIndexOf("/") - 1);
-    const Db cache(filename);                       //generate unique id before file has been deleted
-    const QString id = cache.uniqueId(filename, _videos[side]->modified, "");
+    const Db &cache = Db::forThread();
+    const QString id = _videos[side]->id;
 
     if(!QFileInfo::exists(filename))                //video was already manually deleted, skip to next
     {
+        _removed[side] = true;
         _seekForwards? on_nextVideo_clicked() : on_prevVideo_clicked();
         return;
     }
@@ -414,17 +564,21 @@ void Comparison::deleteVideo(const int &side)
         {
             _videosDeleted++;
             _spaceSaved = _spaceSaved + _videos[side]->size;
-            cache.removeVideo(id);
+            cache.removeVideo(id, Db::uniqueId(filename, _videos[side]->modified, ""));
+            _removed[side] = true;                  //only pairs with this video are skipped from now on
             emit sendStatusMessage(QString("Deleted %1").arg(QDir::toNativeSeparators(filename)));
             _seekForwards? on_nextVideo_clicked() : on_prevVideo_clicked();
         }
     }
 }
 
-void Comparison::moveVideo(const QString &from, const QString &to)
+void Comparison::moveVideo(const int &side, const int &toSide)
 {
+    const QString from = _videos[side]->filename;
+    const QString to = _videos[toSide]->filename;
     if(!QFileInfo::exists(from))
     {
+        _removed[side] = true;
         _seekForwards? on_nextVideo_clicked() : on_prevVideo_clicked();
         return;
     }
@@ -436,10 +590,12 @@ void Comparison::moveVideo(const QString &from, const QString &to)
     if(QMessageBox::question(this, "Move", question, QMessageBox::Yes|QMessageBox::No) == QMessageBox::Yes)
     {
         QFile moveThisFile(from);
-        if(!moveThisFile.rename(QString("%1/%2").arg(toPath, from.right(from.length() - from.lastIndexOf("/") - 1))))
+        const QString moved = QString("%1/%2").arg(toPath, from.right(from.length() - from.lastIndexOf("/") - 1));
+        if(!moveThisFile.rename(moved))
             QMessageBox::information(this, "", "Could not move file. Check file permissions and available disk space.");
         else
         {
+            _videos[side]->filename = moved;        //pairs with this video can still be shown
             emit sendStatusMessage(QString("Moved %1 to %2").arg(QDir::toNativeSeparators(from), toPath));
             _seekForwards? on_nextVideo_clicked() : on_prevVideo_clicked();
         }
@@ -480,7 +636,7 @@ void Comparison::on_swapFilenames_clicked() const
     ui->leftFileName->setText(newLeftFilename);                     //update UI
     ui->rightFileName->setText(newRightFilename);
 
-    Db cache(_videos[_leftVideo]->filename);
+    const Db &cache = Db::forThread();
     cache.removeVideo(cache.uniqueId(oldLeftFilename, oldLeftDatetime, ""));             //remove both videos from cache
     cache.removeVideo(cache.uniqueId(oldRightFilename, oldRightDatetime, ""));
 }
@@ -525,7 +681,7 @@ void Comparison::on_swapFolders_clicked() const
     ui->leftPathName->setText(newLeftPath);                     //update UI
     ui->rightPathName->setText(newRightPath);
 
-    Db cache(_videos[_leftVideo]->filename);
+    const Db &cache = Db::forThread();
     cache.removeVideo(cache.uniqueId(leftFilename, oldLeftDatetime, ""));             //remove both videos from cache
     cache.removeVideo(cache.uniqueId(rightFilename, oldRightDatetime, ""));
 }
@@ -587,13 +743,15 @@ void Comparison::on_swapFilesToFolders_clicked() const
     ui->leftFileName->setText(newLeftFilenameAfterRename);
     ui->rightFileName->setText(newRightFilenameAfterRename);
 
-    Db cache(_videos[_leftVideo]->filename);
+    const Db &cache = Db::forThread();
     cache.removeVideo(cache.uniqueId(leftFilename, oldLeftDatetime, ""));             //remove both videos from cache
     cache.removeVideo(cache.uniqueId(rightFilename, oldRightDatetime, ""));
 }
 
 void Comparison::on_thresholdSlider_valueChanged(const int &value)
 {
+    _matchesOutdated = true;
+    ui->histogram->setRange(value, ui->thresholdSliderMax->value());
     _prefs._thresholdSSIM = value / 100.0;
     const int matchingBitsOf64 = static_cast<int>(round(64 * _prefs._thresholdSSIM));
     _prefs._thresholdPhash = matchingBitsOf64;
@@ -617,6 +775,8 @@ void Comparison::on_thresholdSlider_valueChanged(const int &value)
 
 void Comparison::on_thresholdSliderMax_valueChanged(const int &value)
 {
+    _matchesOutdated = true;
+    ui->histogram->setRange(ui->thresholdSlider->value(), value);
     _prefs._thresholdSSIMMax = value / 100.0;
     const int matchingBitsOf64 = static_cast<int>(round(64 * _prefs._thresholdSSIMMax));
     _prefs._thresholdPhashMax = matchingBitsOf64;
@@ -642,15 +802,8 @@ void Comparison::resizeEvent(QResizeEvent*)
     if(ui->leftFileName->text().isEmpty() || _leftVideo >= _prefs._numberOfVideos || _rightVideo >= _prefs._numberOfVideos)
         return;     //automatic initial resize event can happen before closing when values went over limit
 
-    QImage image;
-    QBuffer leftPixels(&_videos[_leftVideo]->thumbnail);
-    image.load(&leftPixels, QByteArrayLiteral("JPG"));
-    ui->leftImage->setPixmap(QPixmap::fromImage(image).scaled(
-                             ui->leftImage->width(), ui->leftImage->height(), Qt::KeepAspectRatio));
-    QBuffer rightPixels(&_videos[_rightVideo]->thumbnail);
-    image.load(&rightPixels, QByteArrayLiteral("JPG"));
-    ui->rightImage->setPixmap(QPixmap::fromImage(image).scaled(
-                              ui->rightImage->width(), ui->rightImage->height(), Qt::KeepAspectRatio));
+    ui->leftImage->setPixmap(pixmap(_leftVideo, ui->leftImage->size()));
+    ui->rightImage->setPixmap(pixmap(_rightVideo, ui->rightImage->size()));
 }
 
 void Comparison::wheelEvent(QWheelEvent *event)
@@ -719,3 +872,25 @@ void Comparison::wheelEvent(QWheelEvent *event)
     ui->rightImage->setPixmap(pix.scaled(ui->rightImage->width(), ui->rightImage->height(),
                                          Qt::KeepAspectRatio, Qt::FastTransformation));
 }
+
+void ThresholdHistogram::paintEvent(QPaintEvent *event)
+{
+    Q_UNUSED (event)
+    if(_counts.isEmpty())
+        return;
+
+    QPainter painter(this);
+    const double barWidth = width() / static_cast<double>(_counts.count());
+    const int most = *std::max_element(_counts.cbegin(), _counts.cend());
+    if(_floor > 0)
+        painter.fillRect(QRectF(0, 0, barWidth * _floor, height()), palette().window().color().darker(110));
+    for(int percent=0; percent<_counts.count(); percent++)
+    {
+        if(_counts[percent] == 0)
+            continue;                               //log scale, so a few matches still show next to many pairs
+        const double barHeight = height() * std::log1p(_counts[percent]) / std::log1p(most);
+        const bool inRange = percent >= _minimum && percent <= _maximum;
+        painter.fillRect(QRectF(barWidth * percent, height() - barHeight, barWidth, barHeight),
+                         inRange? palette().highlight().color() : palette().mid().color());
+    }
+}
@@ -2,10 +2,14 @@
 #define COMPARISON_H
 
 #include <QDialog>
+#include <QCache>
+#include <QSet>
+#include <QThreadPool>
 #include <QDesktopServices>
 #include <QUrl>
 #include <QLabel>
-#include "video.h"
+#include "matcher.h"
+#include "phashindex.h"
 
 namespace Ui { class Comparison; }
 
@@ -14,7 +18,8 @@ class Comparison : public QDialog
     Q_OBJECT
 
 public:
-    Comparison(const QVector<Video *> &videosParam, const Prefs &prefsParam);
+    Comparison(const QVector<Video *> &videosParam, const FingerprintStore &storeParam, const int &fingerprintModeParam,
+               const Prefs &prefsParam);
     ~Comparison();
 
     void reportMatchingVideos();
@@ -24,15 +29,44 @@ private:
 
     QVector<Video *> _videos;
     Prefs _prefs;
+    const Matcher _matcher;
+    const FingerprintStore &_store;                     //same order as _videos
+    const int _fingerprintMode;                         //of cache rows videos were ingested with, for thumbnails
+    PhashIndex _index;
+
+    struct ScoredPair { int left; int right; int phash; float ssim; };     //small, there can be millions
+    QVector<ScoredPair> _scored;                        //pairs at least _scoredPhash similar, most similar first
+    int _scoredPhash = 0;
+    int _scoredSsimPhash = 0;                           //SSIM of a pair is best one of hashes at least this similar
+    int _scoredMode = -1;                               //comparison mode pairs were scored in
+    static constexpr int _scoreMargin = 8;              //pHash bits below threshold also scored, to lower it instantly
+    QVector<int> _matches;                              //positions in _scored matching thresholds, by left and right
+    int _match = -1;                                    //position of pair shown
+    bool _matchesOutdated = false;                      //thresholds changed, filter matches again before moving on
+    QVector<bool> _removed;                             //videos deleted, pairs with them are skipped
+
+    MatchScore _score;                                  //of videos shown
     int _leftVideo = 0;
     int _rightVideo = 0;
     int _videosDeleted = 0;
     int64_t _spaceSaved = 0;
     bool _seekForwards = true;
 
-    int _durationModifier = 0;
-    int _phashSimilarity = 0;
-    double _ssimSimilarity = 0.0;
+    static constexpr int _imageCacheBytes = 16 * 1024 * 1024;
+    mutable QCache<QString, QImage> _images { _imageCacheBytes };   //decoded thumbnails by id, least recently shown dropped
+    static QImage loadThumbnail(const QString &id, const int &mode);   //from cache, can be called from any thread
+    QImage image(const int &video) const;
+
+    struct ScaledPixmap { QSize size; QPixmap pixmap; };              //label size pixmap was scaled to
+    static constexpr int _pixmapCacheCount = 24;
+    mutable QCache<QString, ScaledPixmap> _pixmaps { _pixmapCacheCount };  //by id, only at size shown last
+    QPixmap pixmap(const int &video, const QSize &size) const;          //resizing scales from cached image
+
+    static constexpr int _prefetchPairs = 3;            //upcoming pairs decoded while current one is looked at
+    QSet<QString> _prefetching;                         //ids of images being decoded in _prefetchPool
+    QThreadPool _prefetchPool;
+    void prefetch();
+    void prefetchImage(const int &video);
 
     int _zoomLevel = 0;
     QPixmap _leftZoomed;
@@ -43,8 +77,6 @@ private:
     int _rightH = 0;
 
     void confirmToExit();
-    bool bothVideosMatch(const Video *left, const Video *right);
-    int phashSimilarity(const Video *left, const Video *right, const int &leftHash, const int &rightHash);
 
     void showVideo(const QString &side) const;
 
@@ -52,7 +84,15 @@ private:
     QString readableFileSize(const int64_t &filesize) const;
     QString readableBitRate(const double &kbps) const;
 
-    int comparisonsSoFar() const;
+    static constexpr int _tileSize = 64;               //videos after each other are compared by same thread
+    static constexpr int _scoringDialogDelayMs = 500;  //progress dialog only shown if scoring takes longer
+    static constexpr int _scoringProgressMs = 100;
+    bool scorePairs();                                  //false if cancelled
+    bool filterMatches();                               //false if cancelled before any pairs were scored
+    static constexpr int _progressSteps = 10000;       //pairs of many videos are more than an int can hold
+    int64_t comparisonsSoFar() const;
+    int progress() const;                               //comparisons so far in steps of progress bar
+    bool showMatch(const int &position);
     void highlightBetterProperties() const;
     void updateUI();
 
@@ -60,11 +100,7 @@ private:
 
     void deleteVideo(const int &side);
 
-    void moveVideo(const QString &from, const QString &to);
-
-    double sigma(const cv::Mat &m, const int &i, const int &j, const int &block_size) const;
-    double covariance(const cv::Mat &m0, const cv::Mat &m1, const int &i, const int &j, const int &block_size) const;
-    double ssim(const cv::Mat &m0, const cv::Mat &m1, const int &block_size) const;
+    void moveVideo(const int &side, const int &toSide);
 
     void resizeEvent(QResizeEvent *event);
     void wheelEvent(QWheelEvent *event);
@@ -74,8 +110,10 @@ private slots:
     void on_nextVideo_clicked();
 
     void on_selectPhash_clicked ( const bool &checked) { if(checked) _prefs._comparisonMode = _prefs._PHASH;
+                                                         _matchesOutdated = true;
                                                          emit switchComparisonMode(_prefs._comparisonMode); }
     void on_selectSSIM_clicked ( const bool &checked) { if(checked) _prefs._comparisonMode = _prefs._SSIM;
+                                                        _matchesOutdated = true;
                                                         emit switchComparisonMode(_prefs._comparisonMode); }
 
     void on_leftImage_clicked() { QDesktopServices::openUrl(QUrl::fromLocalFile(_videos[_leftVideo]->filename)); }
@@ -87,8 +125,8 @@ private slots:
     void on_leftDelete_clicked() { deleteVideo(_leftVideo); }
     void on_rightDelete_clicked() { deleteVideo(_rightVideo); }
 
-    void on_leftMove_clicked() { moveVideo(_videos[_leftVideo]->filename, _videos[_rightVideo]->filename); }
-    void on_rightMove_clicked() { moveVideo(_videos[_rightVideo]->filename, _videos[_leftVideo]->filename); }
+    void on_leftMove_clicked() { moveVideo(_leftVideo, _rightVideo); }
+    void on_rightMove_clicked() { moveVideo(_rightVideo, _leftVideo); }
     void on_swapFilenames_clicked() const;
     void on_swapFolders_clicked() const;
     void on_swapFilesToFolders_clicked() const;
@@ -106,6 +144,23 @@ signals:
 };
 
 
+//number of scored pairs at each similarity in percent, pairs within thresholds highlighted
+class ThresholdHistogram : public QWidget
+{
+    Q_OBJECT
+public:
+    explicit ThresholdHistogram(QWidget *parent) : QWidget(parent) { }
+    void setCounts(const QVector<int> &counts, const int &floor) { _counts = counts; _floor = floor; update(); }
+    void setRange(const int &minimum, const int &maximum) { _minimum = minimum; _maximum = maximum; update(); }
+protected:
+    void paintEvent(QPaintEvent *event);
+private:
+    QVector<int> _counts;
+    int _floor = 0;                                     //less similar pairs were not scored
+    int _minimum = 0;
+    int _maximum = 100;
+};
+
 class ClickableLabel : public QLabel
 {
     Q_OBJECT
@@ -1,6 +1,11 @@
 #include <QApplication>
 #include <QCryptographicHash>
-#include <QSqlQuery>
+#include <QDataStream>
+#include <QFileInfo>
+#include <QSqlRecord>
+#include <QThread>
+#include <QThreadPool>
+#include <QThreadStorage>
 #include "db.h"
 #include "video.h"
 
@@ -15,6 +20,26 @@ Db::Db(const QString &connectionParam)
     //createTables();
 }
 
+const Db &Db::forThread()
+{
+    static QThreadStorage<Db *> connections;       //deleted (and connection closed) when thread ends
+    if(!connections.hasLocalData())
+        connections.setLocalData(new Db(QStringLiteral("thread%1")
+                                        .arg(reinterpret_cast<quintptr>(QThread::currentThreadId()))));
+    return *connections.localData();
+}
+
+QSqlQuery &Db::prepared(const QString &statement) const
+{
+    auto query = _prepared.find(statement);
+    if(query == _prepared.end())
+    {
+        query = _prepared.try_emplace(statement, _db).first;
+        (void)query->second.prepare(statement);
+    }
+    return query->second;
+}
+
 QString Db::uniqueId(const QString &filename, const QDateTime &dateMod, const QString &id)
 {
     if(filename.isEmpty())
@@ -25,6 +50,105 @@ QString Db::uniqueId(const QString &filename, const QDateTime &dateMod, const QS
     return QCryptographicHash::hash(name_modified.toLatin1(), QCryptographicHash::Md5).toHex();
 }
 
+QString Db::contentId(const QString &filename)
+{
+    QFile file(filename);
+    if(!file.open(QIODevice::ReadOnly))
+        return QString();
+
+    const int64_t sampleSize = 64 * 1024;
+    const int64_t size = file.size();
+    QCryptographicHash hash(QCryptographicHash::Md5);
+    hash.addData(QByteArray::number(static_cast<qlonglong>(size)));
+    for(const int64_t &offset : { int64_t(0), (size - sampleSize) / 2, size - sampleSize })
+    {
+        if(!file.seek(qMax(int64_t(0), offset)))
+            return QString();
+        hash.addData(file.read(sampleSize));
+    }
+    return hash.result().toHex();
+}
+
+QVector<QVariantList> Db::resolveContentIds(const QVector<Video *> &videos) const
+{
+    QHash<QString, Video *> videosByPathId;         //video ids are still made from filename and modified date here
+    for(const auto &video : videos)
+        videosByPathId[video->id] = video;
+
+    const QVector<QString> pathIds = videosByPathId.keys();
+    QSqlQuery query(_db);
+    query.setForwardOnly(true);
+    for(int i=0; i<pathIds.count(); i+=1000)
+    {
+        (void)query.exec(QStringLiteral("SELECT pathid, id FROM paths WHERE pathid in ('%1');")
+                         .arg(pathIds.mid(i, 1000).join(QStringLiteral("', '"))));
+        while(query.next())
+            videosByPathId.take(query.value(0).toString())->id = query.value(1).toString();
+    }
+
+    QThreadPool hashers;                            //remaining videos are new, renamed, moved or modified
+    for(Video *video : std::as_const(videosByPathId))
+        hashers.start([video]() {
+            const QString id = contentId(video->filename);
+            if(!id.isEmpty())
+                video->id = id;
+        });
+    hashers.waitForDone();
+
+    QVector<QVariantList> rows;
+    for(auto video = videosByPathId.cbegin(); video != videosByPathId.cend(); ++video)
+        if(video.value()->id != video.key())
+            rows.append({ video.key(), video.value()->filename, video.value()->id });
+    return rows;
+}
+
+void Db::writePath(const QVariantList &row) const
+{
+    QSqlQuery &query = prepared(QStringLiteral("INSERT OR REPLACE INTO paths VALUES(?,?,?);"));
+    for(int i=0; i<row.count(); i++)
+        query.bindValue(i, row[i]);
+    (void)query.exec();
+    query.finish();
+}
+
+bool Db::readDirectory(const QString &path, const QString &filter, const QDateTime &modified,
+                       DirectoryListing &listing) const
+{
+    QSqlQuery &query = prepared(QStringLiteral("SELECT listing FROM directories WHERE path = ? AND modified = ? AND filter = ?;"));
+    query.bindValue(0, path);
+    query.bindValue(1, modified.toMSecsSinceEpoch());
+    query.bindValue(2, filter);
+    (void)query.exec();
+
+    bool cached = false;
+    if(query.next())
+    {
+        QDataStream stream(query.value(0).toByteArray());
+        stream >> listing.files >> listing.fileModified >> listing.subfolders;
+        cached = stream.status() == QDataStream::Ok && listing.files.count() == listing.fileModified.count();
+    }
+    query.finish();
+    return cached;
+}
+
+QVariantList Db::directoryRow(const QString &path, const QString &filter, const QDateTime &modified,
+                              const DirectoryListing &listing)
+{
+    QByteArray serialized;
+    QDataStream stream(&serialized, QIODevice::WriteOnly);
+    stream << listing.files << listing.fileModified << listing.subfolders;
+    return { path, modified.toMSecsSinceEpoch(), filter, serialized };
+}
+
+void Db::writeDirectory(const QVariantList &row) const
+{
+    QSqlQuery &query = prepared(QStringLiteral("INSERT OR REPLACE INTO directories VALUES(?,?,?,?);"));
+    for(int i=0; i<row.count(); i++)
+        query.bindValue(i, row[i]);
+    (void)query.exec();
+    query.finish();
+}
+
 void Db::createTables() const
 {
     QSqlQuery query(_db);
@@ -33,11 +157,42 @@ void Db::createTables() const
 
     (void)query.exec(QStringLiteral("CREATE TABLE IF NOT EXISTS metadata (id TEXT PRIMARY KEY, "
                               "size INTEGER, duration INTEGER, bitrate INTEGER, framerate REAL, "
-                              "codec TEXT, audio TEXT, width INTEGER, height INTEGER);"));
+                              "codec TEXT, audio TEXT, width INTEGER, height INTEGER, filename TEXT, accessed INTEGER);"));
+    (void)query.exec(QStringLiteral("ALTER TABLE metadata ADD COLUMN filename TEXT;"));    //cache made by older version
+    (void)query.exec(QStringLiteral("ALTER TABLE metadata ADD COLUMN accessed INTEGER;"));
+    (void)query.exec(QStringLiteral("CREATE INDEX IF NOT EXISTS metadata_accessed ON metadata (accessed);"));
 
-    (void)query.exec(QStringLiteral("CREATE TABLE IF NOT EXISTS capture (id TEXT PRIMARY KEY, "
+    const QString captureColumns = QStringLiteral("at8, at16, at24, at32, at36, at40, at48, at52, "
+                                                  "at56, at60, at64, at68, at72, at80, at88, at96");
+    //cache made by older version has no seek mode in capture primary key, its captures are moved to a new table.
+    //capture_exact is left over if an earlier version was interrupted while moving them
+    const QStringList tables = _db.tables();
+    const bool exactCapturesOnly = tables.contains(QStringLiteral("capture")) &&
+                                   !_db.record(QStringLiteral("capture")).contains(QStringLiteral("seek"));
+    const bool interrupted = tables.contains(QStringLiteral("capture_exact"));
+    QSqlDatabase db = _db;
+    (void)db.transaction();                 //captures are migrated completely or not at all
+    bool migrated = !exactCapturesOnly || query.exec(QStringLiteral("ALTER TABLE capture RENAME TO capture_exact;"));
+    migrated = migrated && query.exec(QStringLiteral("CREATE TABLE IF NOT EXISTS capture (id TEXT, seek INTEGER, "
                               " at8 BLOB, at16 BLOB, at24 BLOB, at32 BLOB, at36 BLOB, at40 BLOB, at48 BLOB, at52 BLOB, "
-                              "at56 BLOB, at60 BLOB, at64 BLOB, at68 BLOB, at72 BLOB, at80 BLOB, at88 BLOB, at96 BLOB);"));
+                              "at56 BLOB, at60 BLOB, at64 BLOB, at68 BLOB, at72 BLOB, at80 BLOB, at88 BLOB, at96 BLOB, "
+                              "PRIMARY KEY (id, seek));"));
+    if(exactCapturesOnly || interrupted)    //those captures were all taken at exact positions
+        migrated = migrated &&
+            query.exec(QStringLiteral("INSERT OR IGNORE INTO capture SELECT id, 0, %1 FROM capture_exact;")
+                       .arg(captureColumns)) &&
+            query.exec(QStringLiteral("DROP TABLE capture_exact;"));
+    if(!migrated || !db.commit())
+        (void)db.rollback();                //old table stays as it was, migration is tried again next time
+
+    (void)query.exec(QStringLiteral("CREATE TABLE IF NOT EXISTS fingerprint (id TEXT, mode INTEGER, "
+                              "hashes BLOB, ssim BLOB, thumbnail BLOB, PRIMARY KEY (id, mode));"));
+
+    (void)query.exec(QStringLiteral("CREATE TABLE IF NOT EXISTS paths (pathid TEXT PRIMARY KEY, "
+                              "filename TEXT, id TEXT);"));
+
+    (void)query.exec(QStringLiteral("CREATE TABLE IF NOT EXISTS directories (path TEXT PRIMARY KEY, "
+                              "modified INTEGER, filter TEXT, listing BLOB);"));
 
     (void)query.exec(QStringLiteral("CREATE TABLE IF NOT EXISTS version (version TEXT PRIMARY KEY);"));
     (void)query.exec(QStringLiteral("INSERT OR REPLACE INTO version VALUES('%1');").arg(APP_VERSION));
@@ -45,12 +200,13 @@ void Db::createTables() const
 
 bool Db::readMetadata(Video &video) const
 {
-    QSqlQuery query(_db);
-    (void)query.exec(QStringLiteral("SELECT * FROM metadata WHERE id = '%1';").arg(video.id));
+    QSqlQuery &query = prepared(QStringLiteral("SELECT * FROM metadata WHERE id = ?;"));
+    query.bindValue(0, video.id);
+    (void)query.exec();
 
+    bool cached = false;
     while(query.next())
     {
-        video.modified = video.modified;
         video.size = query.value(1).toLongLong();
         video.duration = query.value(2).toLongLong();
         video.bitrate = query.value(3).toInt();
@@ -59,71 +215,86 @@ bool Db::readMetadata(Video &video) const
         video.audio = query.value(6).toString();
         video.width = static_cast<short>(query.value(7).toInt());
         video.height = static_cast<short>(query.value(8).toInt());
-        return true;
+        cached = true;
     }
-    return false;
+    query.finish();
+    return cached;
 }
 
 //make hashmap
-void Db::populateMetadatas(const QHash<QString, Video *> _everyVideo) const
+void Db::populateMetadatas(const QVector<Video *> &videos) const
 {
     QSqlQuery query(_db);
     QString inArgs = "";
     int count = 0;
     const int limit = 1000;
 
-    QHashIterator<QString, Video *> i(_everyVideo);
-
-    while (i.hasNext()) {
-        i.next();
+    QMultiHash<QString, Video *> videosById;        //identical copies share an id when videos are identified by content
+    for(int i=0; i<videos.count(); i++) {
+        videosById.insert(videos[i]->id, videos[i]);
         if(inArgs.length() == 0){
-           inArgs = QStringLiteral("'%1'").arg(i.key());
+           inArgs = QStringLiteral("'%1'").arg(videos[i]->id);
         } else {
-            inArgs += QStringLiteral(", '%1'").arg(i.key());
+            inArgs += QStringLiteral(", '%1'").arg(videos[i]->id);
         }
         count++;
-        if(count == limit || !i.hasNext()){
+        if(count == limit || i == videos.count() - 1){
              (void)query.exec(QStringLiteral("SELECT * FROM metadata WHERE id in (%1);").arg(inArgs));
 
              while(query.next()){
                  const QString id = query.value("id").toString();
-                 Video *video = _everyVideo[id];
-                 video->size = query.value(1).toLongLong();
-                 video->duration = query.value(2).toLongLong();
-                 video->bitrate = query.value(3).toInt();
-                 video->framerate = query.value(4).toDouble();
-                 video->codec = query.value(5).toString();
-                 video->audio = query.value(6).toString();
-                 video->width = static_cast<short>(query.value(7).toInt());
-                 video->height = static_cast<short>(query.value(8).toInt());
-                 video->cachedMetadata = true;
+                 for(Video *video : videosById.values(id)){
+                     video->size = query.value(1).toLongLong();
+                     video->duration = query.value(2).toLongLong();
+                     video->bitrate = query.value(3).toInt();
+                     video->framerate = query.value(4).toDouble();
+                     video->codec = query.value(5).toString();
+                     video->audio = query.value(6).toString();
+                     video->width = static_cast<short>(query.value(7).toInt());
+                     video->height = static_cast<short>(query.value(8).toInt());
+                     video->cachedMetadata = true;
+                 }
              }
              count = 0;
+             inArgs = "";
         }
     }
 }
 
-void Db::writeMetadata(const Video &video) const
+QVariantList Db::metadataRow(const Video &video)
 {
-    QSqlQuery query(_db);
-    (void)query.exec(QStringLiteral("INSERT OR REPLACE INTO metadata VALUES('%1',%2,%3,%4,%5,'%6','%7',%8,%9);")
-               .arg(video.id).arg(video.size).arg(video.duration).arg(video.bitrate).arg(video.framerate)
-               .arg(video.codec, video.audio).arg(video.width).arg(video.height));
+    return { video.id, static_cast<qlonglong>(video.size), static_cast<qlonglong>(video.duration), video.bitrate,
+             video.framerate, video.codec, video.audio, video.width, video.height,
+             video.filename, QDateTime::currentSecsSinceEpoch() };
 }
 
-QByteArray Db::readCapture(const QString &id, const int &percent) const
+void Db::writeMetadata(const QVariantList &row) const
 {
-    QSqlQuery query(_db);
-    (void)query.exec(QStringLiteral("SELECT at%1 FROM capture WHERE id = '%2';").arg(percent).arg(id));
+    QSqlQuery &query = prepared(QStringLiteral("INSERT OR REPLACE INTO metadata (id, size, duration, bitrate, "
+                                               "framerate, codec, audio, width, height, filename, accessed) "
+                                               "VALUES(?,?,?,?,?,?,?,?,?,?,?);"));
+    for(int i=0; i<row.count(); i++)
+        query.bindValue(i, row[i]);
+    (void)query.exec();
+}
+
+QByteArray Db::readCapture(const QString &id, const int &percent, const bool &keyframes) const
+{
+    QSqlQuery &query = prepared(QStringLiteral("SELECT at%1 FROM capture WHERE id = ? AND seek = ?;").arg(percent));
+    query.bindValue(0, id);
+    query.bindValue(1, keyframes? 1 : 0);
+    (void)query.exec();
 
+    QByteArray capture;
     while(query.next())
-        return query.value(0).toByteArray();
-    return nullptr;
+        capture = query.value(0).toByteArray();
+    query.finish();
+    return capture;
 }
 
-QHash<int, QByteArray>  Db::readCaptures(const QString &id, const QVector<int> &percentages) const
+QHash<int, QByteArray>  Db::readCaptures(const QString &id, const QVector<int> &percentages,
+                                         const bool &keyframes) const
 {
-    QSqlQuery query(_db);
     QString args = "";
     QHash<int, QByteArray> result;
 
@@ -135,37 +306,38 @@ QHash<int, QByteArray>  Db::readCaptures(const QString &id, const QVector<int> &
             args += ", at" + QString::number(percentage);
         }
     }
-    (void)query.exec(args + QStringLiteral(" FROM capture WHERE id = '%1';").arg(id));
+    QSqlQuery &query = prepared(args + QStringLiteral(" FROM capture WHERE id = ? AND seek = ?;"));  //same columns
+    query.bindValue(0, id);                                                                         //for every video
+    query.bindValue(1, keyframes? 1 : 0);
+    (void)query.exec();
 
     for(auto percentage : percentages)
     {
         result[percentage] = nullptr;
     }
     while(query.next()){
-        for(auto percentage : percentages)
+        for(int i=0; i<percentages.count(); i++)
         {
-            result[percentage] = query.value(QStringLiteral("at%1").arg(percentage)).toByteArray();
+            result[percentages[i]] = query.value(i).toByteArray();
         }
     }
+    query.finish();
     return result;
 }
 
 
-QHash<int, QByteArray>  Db::readCapturesOfVideos(const QVector<QString> &ids, const QVector<int> &percentages) const
+QHash<QString, QHash<int, QByteArray>> Db::readCapturesOfVideos(const QVector<QString> &ids,
+                                                                const QVector<int> &percentages,
+                                                                const bool &keyframes) const
 {
     QSqlQuery query(_db);
-    QString args = "";
+    query.setForwardOnly(true);
+    QString args = "SELECT id";
     QString inArgs = "";
-    QHash<int, QByteArray> result;
+    QHash<QString, QHash<int, QByteArray>> result;
 
     for(auto percentage : percentages)
-    {
-        if(args.length() == 0){
-           args = "SELECT id, at" + QString::number(percentage);
-        } else {
-            args += ", at" + QString::number(percentage);
-        }
-    }
+        args += ", at" + QString::number(percentage);
 
     for(const QString& id : ids)
     {
@@ -175,34 +347,119 @@ QHash<int, QByteArray>  Db::readCapturesOfVideos(const QVector<QString> &ids, co
             inArgs += QStringLiteral(", '%1'").arg(id);
         }
     }
-    (void)query.exec(args + QStringLiteral(" FROM capture WHERE id in (%1);").arg(inArgs));
+    (void)query.exec(args + QStringLiteral(" FROM capture WHERE seek = %1 AND id in (%2);")
+                     .arg(keyframes? 1 : 0).arg(inArgs));
 
-    for(auto percentage : percentages)
+    while(query.next()){
+        QHash<int, QByteArray> &captures = result[query.value(0).toString()];
+        for(int i=0; i<percentages.count(); i++)
+            captures[percentages[i]] = query.value(i + 1).toByteArray();
+    }
+    return result;
+}
+
+void Db::populateCaptures(const QVector<Video *> &videos, const QVector<int> &percentages,
+                          const bool &keyframes) const
+{
+    if(videos.isEmpty())
+        return;
+
+    QVector<QString> ids;
+    for(const auto &video : videos)
+        ids << video->id;
+
+    QHash<QString, QHash<int, QByteArray>> captures = readCapturesOfVideos(ids, percentages, keyframes);
+    for(const auto &video : videos)
     {
-        result[percentage] = nullptr;
+        video->prefetchedCaptures = captures.value(video->id);     //videos not in cache get empty hash
+        video->capturesPrefetched = true;
+    }
+}
+
+void Db::populateFingerprints(const QVector<Video *> &videos, const int &mode) const
+{
+    QMultiHash<QString, Video *> videosById;
+    QString inArgs = "";
+    for(const auto &video : videos)
+    {
+        videosById.insert(video->id, video);
+        if(inArgs.length() == 0){
+           inArgs = QStringLiteral("'%1'").arg(video->id);
+        } else {
+            inArgs += QStringLiteral(", '%1'").arg(video->id);
+        }
     }
+    if(videosById.isEmpty())
+        return;
+
+    QSqlQuery query(_db);
+    query.setForwardOnly(true);
+    (void)query.exec(QStringLiteral("SELECT id, hashes, ssim FROM fingerprint WHERE mode = %1 AND id in (%2);")
+                     .arg(mode).arg(inArgs));
+
     while(query.next()){
-        for(auto percentage : percentages)
+        const QByteArray hashes = query.value(1).toByteArray();
+        const QByteArray ssim = query.value(2).toByteArray();
+        const int count = static_cast<int>(hashes.size() / sizeof(uint64_t));
+        if(count < 1 || count > 16 || ssim.size() != count * Video::_ssimSize * Video::_ssimSize)
+            continue;
+
+        for(Video *video : videosById.values(query.value(0).toString()))
         {
-            result[percentage] = query.value(QStringLiteral("at%1").arg(percentage)).toByteArray();
+            memcpy(video->hash, hashes.constData(), static_cast<size_t>(count) * sizeof(uint64_t));
+            video->grayThumb = ssim;        //ssim thumbnails are 16x16 grayscale bytes in cache as in memory
+            video->cachedFingerprint = true;
         }
     }
-    return result;
 }
 
-void Db::writeCapture(const QString &id, const int &percent, const QByteArray &image) const
+QByteArray Db::readThumbnail(const QString &id, const int &mode) const
 {
-    QSqlQuery query(_db);
-    (void)query.exec(QStringLiteral("INSERT OR IGNORE INTO capture (id) VALUES('%1');").arg(id));
+    QSqlQuery &query = prepared(QStringLiteral("SELECT thumbnail FROM fingerprint WHERE id = ? AND mode = ?;"));
+    query.bindValue(0, id);
+    query.bindValue(1, mode);
+    (void)query.exec();
 
-    (void)query.prepare(QStringLiteral("UPDATE capture SET at%1 = :image WHERE id = '%2';").arg(percent).arg(id));
-    query.bindValue(QStringLiteral(":image"), image);
+    QByteArray thumbnail;
+    if(query.next())
+        thumbnail = query.value(0).toByteArray();
+    return thumbnail;
+}
+
+QVariantList Db::fingerprintRow(const Video &video, const int &mode)
+{
+    const int count = static_cast<int>(video.grayThumb.size()) / (Video::_ssimSize * Video::_ssimSize);
+    const QByteArray hashes(reinterpret_cast<const char *>(video.hash), count * static_cast<int>(sizeof(uint64_t)));
+
+    return { video.id, mode, hashes, video.grayThumb, video.thumbnail };
+}
+
+bool Db::writeFingerprint(const QVariantList &row) const
+{
+    QSqlQuery &query = prepared(QStringLiteral("INSERT OR REPLACE INTO fingerprint VALUES(?,?,?,?,?);"));
+    for(int i=0; i<row.count(); i++)
+        query.bindValue(i, row[i]);
+    return query.exec();
+}
+
+void Db::writeCapture(const QString &id, const int &percent, const bool &keyframes, const QByteArray &image) const
+{
+    QSqlQuery &query = prepared(QStringLiteral("INSERT INTO capture (id, seek, at%1) VALUES(?, ?, ?) "
+                                               "ON CONFLICT(id, seek) DO UPDATE SET at%1 = excluded.at%1;").arg(percent));
+    query.bindValue(0, id);
+    query.bindValue(1, keyframes? 1 : 0);
+    query.bindValue(2, image);
     (void)query.exec();
 }
 
-bool Db::removeVideo(const QString &id) const
+bool Db::removeVideo(const QString &id, const QString &pathId) const
 {
     QSqlQuery query(_db);
+    (void)query.exec(QStringLiteral("DELETE FROM paths WHERE pathid = '%1';").arg(pathId.isEmpty()? id : pathId));
+
+    (void)query.exec(QStringLiteral("SELECT pathid FROM paths WHERE id = '%1' LIMIT 1;").arg(id));
+    while(query.next())
+        return false;                               //identical copy elsewhere still uses cached fingerprint
 
     bool idCached = false;
     (void)query.exec(QStringLiteral("SELECT id FROM metadata WHERE id = '%1';").arg(id));
@@ -213,9 +470,133 @@ bool Db::removeVideo(const QString &id) const
 
     (void)query.exec(QStringLiteral("DELETE FROM metadata WHERE id = '%1';").arg(id));
     (void)query.exec(QStringLiteral("DELETE FROM capture WHERE id = '%1';").arg(id));
+    (void)query.exec(QStringLiteral("DELETE FROM fingerprint WHERE id = '%1';").arg(id));
 
     (void)query.exec(QStringLiteral("SELECT id FROM metadata WHERE id = '%1';").arg(id));
     while(query.next())
         return false;
     return true;
 }
+
+void Db::writeAccessTime(const QVector<QString> &ids, const QVector<QString> &filenames, const int64_t &time) const
+{
+    for(int i=0; i<ids.count(); i+=1000)
+    {
+        const QStringList batch = ids.mid(i, 1000);
+        QSqlQuery query(_db);
+        (void)query.exec(QStringLiteral("UPDATE metadata SET accessed = %1 WHERE id in ('%2');")
+                         .arg(time).arg(batch.join(QStringLiteral("', '"))));
+    }
+
+    //rows cached by older version have no filename, which removeStaleVideos() needs to find them
+    QSqlQuery &query = prepared(QStringLiteral("UPDATE metadata SET filename = ? WHERE id = ? AND filename IS NULL;"));
+    for(int i=0; i<ids.count(); i++)
+    {
+        query.bindValue(0, filenames[i]);
+        query.bindValue(1, ids[i]);
+        (void)query.exec();
+    }
+    query.finish();
+}
+
+void Db::removeVideos(const QVector<QString> &ids) const
+{
+    QSqlDatabase db = _db;
+    (void)db.transaction();
+    for(int i=0; i<ids.count(); i+=1000)
+    {
+        const QString inArgs = QStringLiteral("'%1'").arg(ids.mid(i, 1000).join(QStringLiteral("', '")));
+        QSqlQuery query(_db);
+        (void)query.exec(QStringLiteral("DELETE FROM metadata WHERE id in (%1);").arg(inArgs));
+        (void)query.exec(QStringLiteral("DELETE FROM capture WHERE id in (%1);").arg(inArgs));
+        (void)query.exec(QStringLiteral("DELETE FROM fingerprint WHERE id in (%1);").arg(inArgs));
+        (void)query.exec(QStringLiteral("DELETE FROM paths WHERE id in (%1);").arg(inArgs));
+    }
+    (void)db.commit();
+}
+
+int Db::removeStaleVideos() const
+{
+    QVector<QString> stalePaths;
+    QSqlQuery query(_db);
+    query.setForwardOnly(true);
+    (void)query.exec(QStringLiteral("SELECT pathid, filename FROM paths;"));
+    while(query.next())
+    {
+        const QString filename = query.value(1).toString();
+        const QFileInfo file(filename);
+        if(!file.exists() || uniqueId(filename, file.lastModified(), "") != query.value(0).toString())
+            stalePaths << query.value(0).toString();
+    }
+    query.finish();
+    for(int i=0; i<stalePaths.count(); i+=1000)
+        (void)query.exec(QStringLiteral("DELETE FROM paths WHERE pathid in ('%1');")
+                         .arg(stalePaths.mid(i, 1000).join(QStringLiteral("', '"))));
+
+    QVector<QString> stale;                         //videos identified by content are kept while any path leads to them
+    (void)query.exec(QStringLiteral("SELECT id, filename FROM metadata WHERE filename IS NOT NULL "
+                                    "AND id NOT IN (SELECT id FROM paths);"));
+    while(query.next())
+    {
+        const QString id = query.value(0).toString();
+        const QString filename = query.value(1).toString();
+        const QFileInfo file(filename);             //id changes when file is renamed, moved or modified
+        if(!file.exists() || uniqueId(filename, file.lastModified(), "") != id)
+            stale << id;
+    }
+    query.finish();
+    removeVideos(stale);
+
+    QVector<QString> staleFolders;
+    (void)query.exec(QStringLiteral("SELECT path FROM directories;"));
+    while(query.next())
+        if(!QFileInfo::exists(query.value(0).toString()))
+            staleFolders << query.value(0).toString();
+    query.finish();
+    for(const auto &folder : std::as_const(staleFolders))
+    {
+        QSqlQuery &remove = prepared(QStringLiteral("DELETE FROM directories WHERE path = ?;"));
+        remove.bindValue(0, folder);
+        (void)remove.exec();
+    }
+
+    //screen captures and fingerprints of videos that were rejected or are no longer in metadata
+    (void)query.exec(QStringLiteral("DELETE FROM capture WHERE id NOT IN (SELECT id FROM metadata);"));
+    (void)query.exec(QStringLiteral("DELETE FROM fingerprint WHERE id NOT IN (SELECT id FROM metadata);"));
+    return stale.count();
+}
+
+int Db::evictLeastRecentlyUsed(const int64_t &maxBytes) const
+{
+    int evicted = 0;
+    QSqlQuery query(_db);
+    query.setForwardOnly(true);
+    while(usedBytes() > maxBytes)
+    {
+        QVector<QString> oldest;                    //never accessed (cached by older version) are first to go
+        (void)query.exec(QStringLiteral("SELECT id FROM metadata ORDER BY accessed LIMIT 500;"));
+        while(query.next())
+            oldest << query.value(0).toString();
+        query.finish();
+        if(oldest.isEmpty())
+            break;
+        removeVideos(oldest);
+        evicted += oldest.count();
+    }
+    return evicted;
+}
+
+int64_t Db::usedBytes() const
+{
+    QSqlQuery query(_db);                       //deleted rows leave free pages, which are not counted
+    (void)query.exec(QStringLiteral("SELECT (page_count - freelist_count) * page_size "
+                                    "FROM pragma_page_count(), pragma_freelist_count(), pragma_page_size();"));
+    return query.next()? query.value(0).toLongLong() : 0;
+}
+
+void Db::compact() const
+{
+    QSqlQuery query(_db);
+    (void)query.exec(QStringLiteral("VACUUM;"));
+    (void)query.exec(QStringLiteral("PRAGMA wal_checkpoint(TRUNCATE);"));
+}
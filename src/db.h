@@ -2,7 +2,11 @@
 #define DB_H
 
 #include <QSqlDatabase>
+#include <QSqlQuery>
 #include <QDateTime>
+#include <QStringList>
+#include <QVariantList>
+#include <map>
 
 class Video;
 
@@ -11,42 +15,129 @@ class Db
 
 public:
     explicit Db(const QString &filename);
-    ~Db() { _db.close(); _db = QSqlDatabase(); _db.removeDatabase(_connection); }
+    ~Db() { _prepared.clear(); _db.close(); _db = QSqlDatabase(); _db.removeDatabase(_connection); }
+
+    //connection of calling thread. opened once per thread and kept, along with its prepared statements
+    static const Db &forThread();
+
+    //group many writes into one transaction
+    void transaction() { (void)_db.transaction(); }
+    bool commit() { return _db.commit(); }
+    void rollback() { (void)_db.rollback(); }           //after failed commit, else transaction stays open
 
 private:
     QSqlDatabase _db;
     QString _connection;
+    mutable std::map<QString, QSqlQuery> _prepared;     //statements are parsed and planned only once
     //QString _id;
     //QDateTime _modified;
 
+    QSqlQuery &prepared(const QString &statement) const;
+
 public:
+    //matching files and subfolders of a folder, as found when folder was last modified
+    struct DirectoryListing
+    {
+        QStringList files;
+        QVector<qint64> fileModified;           //ms since epoch
+        QStringList subfolders;
+    };
+
     //return md5 hash of parameter's file, or (as convinience) md5 hash of the file given to constructor
     static QString uniqueId(const QString &filename, const QDateTime &dateMod, const QString &id);
 
+    //return md5 hash of file size and three 64 KB samples of file, which stays the same when file is renamed or moved
+    static QString contentId(const QString &filename);
+
+    //change ids of videos to their content ids. ids already known for a filename and modified date are read from cache,
+    //others are hashed. returns rows (id made from filename, filename, content id) of videos that were hashed
+    QVector<QVariantList> resolveContentIds(const QVector<Video *> &videos) const;
+
+    //save which content id a filename and modified date have
+    void writePath(const QVariantList &row) const;
+
+    //returns true and fills listing if folder was listed with same filter and has not been modified since
+    bool readDirectory(const QString &path, const QString &filter, const QDateTime &modified,
+                       DirectoryListing &listing) const;
+
+    //copy of folder listing in the order of directories table columns
+    static QVariantList directoryRow(const QString &path, const QString &filter, const QDateTime &modified,
+                                     const DirectoryListing &listing);
+
+    //save folder listing, so folder is not listed again until it is modified
+    void writeDirectory(const QVariantList &row) const;
+
     //constructor creates a database file if there is none already
     void createTables() const;
 
     //return true and updates member variables if the video metadata was cached
     bool readMetadata(Video &video) const;
 
+    //copy of video properties in the order of metadata table columns, safe to write from another thread
+    static QVariantList metadataRow(const Video &video);
+
     //save video properties in cache
-    void writeMetadata(const Video &video) const;
+    void writeMetadata(const QVariantList &row) const;
 
     //returns screen capture if it was cached, else return null ptr
-    QByteArray readCapture(const QString &id, const int &percent) const;
+    QByteArray readCapture(const QString &id, const int &percent, const bool &keyframes) const;
 
     //returns screen capture if it was cached, else return null ptr
-    QHash<int, QByteArray> readCaptures(const QString &id, const QVector<int> &percentages) const;
+    QHash<int, QByteArray> readCaptures(const QString &id, const QVector<int> &percentages,
+                                        const bool &keyframes) const;
+
+    //returns screen captures of all cached videos in one query, keyed by id
+    QHash<QString, QHash<int, QByteArray>> readCapturesOfVideos(const QVector<QString> &ids,
+                                                                const QVector<int> &percentages,
+                                                                const bool &keyframes) const;
 
-    QHash<int, QByteArray> readCapturesOfVideos(const QVector<QString> &ids, const QVector<int> &percentages) const;
+    //load cached screen captures of videos before they are processed, so threads don't need to query cache
+    void populateCaptures(const QVector<Video *> &videos, const QVector<int> &percentages,
+                          const bool &keyframes) const;
+
+    //load hashes and ssim thumbnails of videos that were already processed in this thumbnail mode
+    void populateFingerprints(const QVector<Video *> &videos, const int &mode) const;
+
+    //fingerprint mode of thumbnail mode, different if captures were taken at keyframes only
+    static int fingerprintMode(const int &thumbnails, const bool &keyframes) { return keyframes? thumbnails + 100 : thumbnails; }
+
+    //GUI thumbnail JPEG of video, only read when it is shown. empty if not cached
+    QByteArray readThumbnail(const QString &id, const int &mode) const;
+
+    //copy of hashes, ssim thumbnails and GUI thumbnail in the order of fingerprint table columns
+    static QVariantList fingerprintRow(const Video &video, const int &mode);
+
+    //save hashes, ssim thumbnails and GUI thumbnail, which are all that is needed from screen captures
+    bool writeFingerprint(const QVariantList &row) const;
 
     //save image in cache
-    void writeCapture(const QString &id, const int &percent, const QByteArray &image) const;
+    //captures at keyframes only are kept apart from exact ones, they can be seconds away from requested position
+    void writeCapture(const QString &id, const int &percent, const bool &keyframes, const QByteArray &image) const;
+
+    //removes path of video (pathId of filename, if video is identified by content), and video itself unless other
+    //paths still lead to same content. returns false if id not cached, still in use or could not be removed
+    bool removeVideo(const QString &id, const QString &pathId = QString()) const;
+
+    //load cached properties of videos, in batches of 1000 per query
+    void populateMetadatas(const QVector<Video *> &videos) const;
+
+    //mark videos as used, least recently used ones are removed first if cache grows too large
+    void writeAccessTime(const QVector<QString> &ids, const QVector<QString> &filenames, const int64_t &time) const;
+
+    //remove all cached data of videos
+    void removeVideos(const QVector<QString> &ids) const;
+
+    //remove videos whose file was deleted, moved or modified after caching, returns number of videos removed
+    int removeStaleVideos() const;
+
+    //remove least recently used videos until cache is smaller than maxBytes, returns number of videos removed
+    int evictLeastRecentlyUsed(const int64_t &maxBytes) const;
 
-    //returns false if id not cached or could not be removed
-    bool removeVideo(const QString &id) const;
+    //size of cache, not counting space freed by removed videos
+    int64_t usedBytes() const;
 
-    void populateMetadatas(const QHash<QString, Video *> _everyVideo) const;
+    //shrink cache file to its used size
+    void compact() const;
 };
 
 #endif // DB_H
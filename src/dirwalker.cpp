@@ -0,0 +1,135 @@
+#include <QCoreApplication>
+#include <QDir>
+#include <QRegularExpression>
+#include <QTextStream>
+#include <QTimer>
+#include "dirwalker.h"
+#include "cachewriter.h"
+#include "db.h"
+
+DirWalker::DirWalker(const QStringList &extensions, const bool &skipUnchangedFolders)
+    : _extensions(extensions), _filter(extensions.join(QStringLiteral(";"))), _skipUnchangedFolders(skipUnchangedFolders)
+{
+    _pool.setMaxThreadCount(qMax(8, QThread::idealThreadCount() * 2));     //mostly waiting for disk or network
+}
+
+QStringList DirWalker::readExtensions()
+{
+    QStringList lines;
+    QFile file(QStringLiteral("%1/extensions.ini").arg(QCoreApplication::applicationDirPath()));
+    if(!file.open(QIODevice::ReadOnly))
+        return lines;
+
+    QTextStream text(&file);
+    while(!text.atEnd())
+    {
+        QString line = text.readLine();
+        if(line.startsWith(QStringLiteral(";")) || line.isEmpty())
+            continue;
+
+        static QRegularExpression regex("\\*?\\.");
+        lines << line.replace(regex, "*.");
+    }
+    return lines;
+}
+
+QStringList DirWalker::normalizeRoots(const QStringList &roots)
+{
+#ifdef Q_OS_WIN
+    const Qt::CaseSensitivity caseSensitivity = Qt::CaseInsensitive;
+#else
+    const Qt::CaseSensitivity caseSensitivity = Qt::CaseSensitive;
+#endif
+    QStringList sorted = roots;                         //parent folders are shorter, so they come first
+    std::sort(sorted.begin(), sorted.end(), [](const QString &a, const QString &b) { return a.length() < b.length(); });
+
+    QStringList normalized;
+    QStringList absolute;
+    for(const auto &root : std::as_const(sorted))
+    {
+        const QString path = QDir::cleanPath(QDir(root).absolutePath());
+        bool inside = false;
+        for(const auto &kept : std::as_const(absolute))
+            if(path.compare(kept, caseSensitivity) == 0 ||
+               path.startsWith(kept.endsWith('/')? kept : kept + '/', caseSensitivity))
+            {
+                inside = true;
+                break;
+            }
+        if(inside)
+            continue;
+        absolute << path;
+        normalized << root;
+    }
+    return normalized;
+}
+
+void DirWalker::walk(const QStringList &roots)
+{
+    _settled = QDateTime::currentDateTime().addSecs(-2);
+    if(roots.isEmpty())
+    {
+        QTimer::singleShot(0, this, &DirWalker::finished);
+        return;
+    }
+    _pendingFolders += static_cast<int>(roots.count());
+    for(const auto &root : roots)
+        _pool.start([this, root]() { listFolder(root); });
+}
+
+void DirWalker::listFolder(const QString &folder)
+{
+    if(!_stopped)
+    {
+        const QDateTime folderModified = QFileInfo(folder).lastModified();
+
+        Db::DirectoryListing listing;       //unchanged folder: use files found last time without listing it again
+        if(!_skipUnchangedFolders || !Db::forThread().readDirectory(folder, _filter, folderModified, listing))
+        {
+            const QDir current(folder);     //file sizes and dates come with the listing, not one stat() per file
+            for(const auto &file : current.entryInfoList(_extensions, QDir::Files))
+            {
+                listing.files << file.fileName();
+                listing.fileModified << file.lastModified().toMSecsSinceEpoch();
+            }
+            listing.subfolders = current.entryList(QDir::Dirs | QDir::NoDotAndDotDot | QDir::NoSymLinks);
+            if(_skipUnchangedFolders && folderModified < _settled)
+                CacheWriter::instance().writeDirectory(Db::directoryRow(folder, _filter, folderModified, listing));
+        }
+
+        _pendingFolders += static_cast<int>(listing.subfolders.count());
+        for(const auto &subfolder : std::as_const(listing.subfolders))
+        {
+            const QString path = QStringLiteral("%1/%2").arg(folder, subfolder);
+            _pool.start([this, path]() { listFolder(path); });
+        }
+
+        QStringList filenames;
+        QVector<QDateTime> modified;
+        QMutexLocker locker(&_mutex);
+        for(int i=0; i<listing.files.count(); i++)
+        {
+            _filenames << QStringLiteral("%1/%2").arg(folder, listing.files[i]);
+            _modified << QDateTime::fromMSecsSinceEpoch(listing.fileModified[i]);
+        }
+        if(_filenames.count() >= _chunkSize)
+        {
+            filenames.swap(_filenames);
+            modified.swap(_modified);
+        }
+        locker.unlock();
+        if(!filenames.isEmpty())
+            emit foundVideos(folder, filenames, modified);
+    }
+
+    if(--_pendingFolders == 0)                          //last folder: hand over remaining files
+    {
+        QMutexLocker locker(&_mutex);
+        if(!_filenames.isEmpty())
+            emit foundVideos(folder, _filenames, _modified);
+        _filenames.clear();
+        _modified.clear();
+        locker.unlock();
+        emit finished();
+    }
+}
@@ -0,0 +1,56 @@
+#ifndef DIRWALKER_H
+#define DIRWALKER_H
+
+#include <QObject>
+#include <QDateTime>
+#include <QMutex>
+#include <QStringList>
+#include <QThreadPool>
+#include <atomic>
+
+//lists folders in parallel: each folder is a task on a thread pool, which queues its subfolders as new tasks.
+//found video files are handed to the GUI thread in chunks
+class DirWalker : public QObject
+{
+    Q_OBJECT
+
+public:
+    DirWalker(const QStringList &extensions, const bool &skipUnchangedFolders);
+    ~DirWalker() { stop(); _pool.waitForDone(); }
+
+    //lines of extensions.ini in application folder as name filters ("*.mp4 *.mkv"), empty if file is not found
+    static QStringList readExtensions();
+
+    //remove roots that are the same as or inside another root, so no folder is walked twice
+    static QStringList normalizeRoots(const QStringList &roots);
+
+    //returns immediately, finished() is emitted after last folder was listed
+    void walk(const QStringList &roots);
+
+    //folders not yet listed are skipped
+    void stop() { _stopped = true; }
+
+private:
+    void listFolder(const QString &folder);
+
+    static constexpr int _chunkSize = 500;              //files per foundVideos() signal
+
+    QStringList _extensions;
+    QString _filter;
+    bool _skipUnchangedFolders;
+    QDateTime _settled;                                 //folders modified after this could still change within mtime
+
+    QThreadPool _pool;
+    std::atomic<int> _pendingFolders { 0 };
+    std::atomic<bool> _stopped { false };
+
+    QMutex _mutex;
+    QStringList _filenames;
+    QVector<QDateTime> _modified;
+
+signals:
+    void foundVideos(const QString &folder, const QStringList &filenames, const QVector<QDateTime> &modified);
+    void finished();
+};
+
+#endif // DIRWALKER_H
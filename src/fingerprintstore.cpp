@@ -0,0 +1,74 @@
+#include "fingerprintstore.h"
+
+FingerprintStore::FingerprintStore(const int &hashesPerVideo, const int &blockSize)
+    : _hashesPerVideo(hashesPerVideo), _blockSize(blockSize),
+      _blocks((Video::_ssimSize / blockSize) * (Video::_ssimSize / blockSize))
+{
+}
+
+int FingerprintStore::add(Video &video)
+{
+    for(int h=0; h<_hashesPerVideo; h++)
+        _hashes.push_back(video.hash[h]);
+    _durations.push_back(video.duration);
+    _widths.push_back(video.width);
+    _heights.push_back(video.height);
+
+    if(video.grayThumb.size() < _hashesPerVideo * _thumbnailBytes)
+        _grayOffsets.push_back(-1);
+    else
+    {
+        _grayOffsets.push_back(static_cast<int64_t>(_gray.size()));
+        for(int h=0; h<_hashesPerVideo; h++)
+        {
+            const uint8_t *gray = video.gray(h);
+            _gray.insert(_gray.end(), gray, gray + _thumbnailBytes);
+            const BlockStats stats = BlockStats::of(gray, _blockSize);
+            _means.insert(_means.end(), stats.mean.cbegin(), stats.mean.cend());
+            _variances.insert(_variances.end(), stats.variance.cbegin(), stats.variance.cend());
+        }
+        video.grayThumb = QByteArray();
+    }
+    return count() - 1;
+}
+
+void FingerprintStore::setBlockSize(const int &blockSize)
+{
+    if(blockSize == _blockSize)
+        return;
+    _blockSize = blockSize;
+    _blocks = (Video::_ssimSize / blockSize) * (Video::_ssimSize / blockSize);
+    _means.clear();
+    _variances.clear();
+    for(size_t offset=0; offset<_gray.size(); offset+=_thumbnailBytes)
+    {
+        const BlockStats stats = BlockStats::of(_gray.data() + offset, _blockSize);
+        _means.insert(_means.end(), stats.mean.cbegin(), stats.mean.cend());
+        _variances.insert(_variances.end(), stats.variance.cbegin(), stats.variance.cend());
+    }
+}
+
+int64_t FingerprintStore::thumbnail(const int &video, const int &hash) const
+{
+    if(_grayOffsets[video] < 0)
+        return -1;
+    return _grayOffsets[video] / _thumbnailBytes + hash;
+}
+
+const uint8_t *FingerprintStore::gray(const int &video, const int &hash) const
+{
+    const int64_t thumbnail = this->thumbnail(video, hash);
+    return thumbnail < 0? nullptr : _gray.data() + thumbnail * _thumbnailBytes;
+}
+
+const float *FingerprintStore::mean(const int &video, const int &hash) const
+{
+    const int64_t thumbnail = this->thumbnail(video, hash);
+    return thumbnail < 0? nullptr : _means.data() + thumbnail * _blocks;
+}
+
+const float *FingerprintStore::variance(const int &video, const int &hash) const
+{
+    const int64_t thumbnail = this->thumbnail(video, hash);
+    return thumbnail < 0? nullptr : _variances.data() + thumbnail * _blocks;
+}
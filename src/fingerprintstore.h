@@ -0,0 +1,63 @@
+#ifndef FINGERPRINTSTORE_H
+#define FINGERPRINTSTORE_H
+
+#include <vector>
+#include "video.h"
+#include "phashkernel.h"
+
+struct BlockStats            //mean and variance of each SSIM block of a gray thumbnail, computed once per thumbnail
+{
+    int blockSize = 0;
+    QVector<float> mean;
+    QVector<float> variance;
+
+    static BlockStats of(const uint8_t *gray, const int &blockSize);
+};
+
+//everything comparing videos needs, copied out of Video objects into one array per property: hashes of all videos
+//one after another, durations, dimensions and ssim thumbnails with their block statistics. matching only reads
+//from here, so a pass over all pairs walks a few contiguous arrays instead of following pointers into each video.
+//videos are added as they are accepted and the store is kept as long as they are, for every comparison window
+class FingerprintStore
+{
+public:
+    FingerprintStore(const int &hashesPerVideo, const int &blockSize);
+
+    //returns index of video in store. ssim thumbnails are moved here, video keeps no copy of its own
+    int add(Video &video);
+    void setBlockSize(const int &blockSize);        //block statistics are computed again if size changed
+
+    int count() const { return static_cast<int>(_durations.size()); }
+    int hashesPerVideo() const { return _hashesPerVideo; }
+    int blockSize() const { return _blockSize; }
+
+    const uint64_t *hashes() const { return _hashes.data(); }      //of all videos, aligned for PhashKernel
+    uint64_t hash(const int &video, const int &hash) const { return _hashes[video * _hashesPerVideo + hash]; }
+    int64_t duration(const int &video) const { return _durations[video]; }
+    short width(const int &video) const { return _widths[video]; }
+    short height(const int &video) const { return _heights[video]; }
+
+    //ssim thumbnail of a hash of video and the mean and variance of its blocks, nullptr if video has none
+    const uint8_t *gray(const int &video, const int &hash) const;
+    const float *mean(const int &video, const int &hash) const;
+    const float *variance(const int &video, const int &hash) const;
+
+private:
+    static constexpr int _thumbnailBytes = Video::_ssimSize * Video::_ssimSize;
+
+    int _hashesPerVideo;
+    int _blockSize;
+    int _blocks;                                            //per ssim thumbnail
+    std::vector<uint64_t, AlignedAllocator<uint64_t>> _hashes;
+    std::vector<int64_t> _durations;
+    std::vector<short> _widths;
+    std::vector<short> _heights;
+    std::vector<int64_t> _grayOffsets;                      //where ssim thumbnails of each video start, -1 if none
+    std::vector<uint8_t> _gray;
+    std::vector<float> _means;                              //_blocks values for each thumbnail in _gray
+    std::vector<float> _variances;
+
+    int64_t thumbnail(const int &video, const int &hash) const;    //number of thumbnail in _gray, -1 if none
+};
+
+#endif // FINGERPRINTSTORE_H
@@ -0,0 +1,184 @@
+#include <QCommandLineParser>
+#include <QEventLoop>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include "headless.h"
+#include "cachewriter.h"
+#include "dirwalker.h"
+#include "ingest.h"
+#include "phashkernel.h"
+
+int Headless::run(const QCoreApplication &app)
+{
+    QCommandLineParser parser;
+    parser.setApplicationDescription(QStringLiteral("Find duplicate videos without a window. "
+                                                    "Matching videos are written to stdout as JSON Lines."));
+    parser.addHelpOption();
+    parser.addVersionOption();
+    parser.addPositionalArgument(QStringLiteral("folders"), QStringLiteral("Folders to search for videos."),
+                                 QStringLiteral("folder..."));
+    const QCommandLineOption headless(QStringLiteral("headless"), QStringLiteral("Run without a window."));
+    const QCommandLineOption thumbnails(QStringLiteral("thumbnails"),
+        QStringLiteral("Thumbnail mode: 1x1, 2x1, 3x1, 2x2, 3x2, 3x3, 4x3 or CutEnds (default 4x3)."), QStringLiteral("mode"));
+    const QCommandLineOption comparison(QStringLiteral("comparison"),
+        QStringLiteral("Comparison mode: phash or ssim (default phash)."), QStringLiteral("mode"));
+    const QCommandLineOption threshold(QStringLiteral("threshold"),
+        QStringLiteral("Similarity in percent for videos to match (default 89)."), QStringLiteral("percent"));
+    const QCommandLineOption blockSize(QStringLiteral("ssim-block-size"),
+        QStringLiteral("SSIM block size: 2, 4, 8 or 16 (default 16)."), QStringLiteral("size"));
+    const QCommandLineOption sameDuration(QStringLiteral("same-duration-modifier"),
+        QStringLiteral("Bits added to pHash similarity if durations are within 1s (default 1)."), QStringLiteral("bits"));
+    const QCommandLineOption differentDuration(QStringLiteral("different-duration-modifier"),
+        QStringLiteral("Bits taken from pHash similarity if durations differ (default 4)."), QStringLiteral("bits"));
+    const QCommandLineOption capture(QStringLiteral("capture"),
+        QStringLiteral("Screen captures with opencv, ffmpeg or pipe (default opencv)."), QStringLiteral("engine"));
+    const QCommandLineOption fastSeek(QStringLiteral("fast-seek"), QStringLiteral("Capture keyframes only."));
+    const QCommandLineOption contentIds(QStringLiteral("content-ids"), QStringLiteral("Identify videos by content."));
+    const QCommandLineOption skipUnchanged(QStringLiteral("skip-unchanged-folders"),
+                                           QStringLiteral("Reuse cached listings of folders that were not modified."));
+    parser.addOptions({ headless, thumbnails, comparison, threshold, blockSize, sameDuration, differentDuration,
+                        capture, fastSeek, contentIds, skipUnchanged });
+    parser.process(app);
+
+    Prefs prefs;
+    QTextStream err(stderr);
+    if(parser.isSet(thumbnails))
+    {
+        Thumbnail thumb;
+        prefs._thumbnails = -1;
+        for(int i=0; i<thumb.countModes(); i++)
+            if(thumb.modeName(i).compare(parser.value(thumbnails), Qt::CaseInsensitive) == 0)
+                prefs._thumbnails = i;
+        if(prefs._thumbnails == -1)
+        {
+            err << "Unknown thumbnail mode: " << parser.value(thumbnails) << Qt::endl;
+            return 1;
+        }
+    }
+    if(parser.isSet(comparison))
+        prefs._comparisonMode = parser.value(comparison).compare(QStringLiteral("ssim"), Qt::CaseInsensitive) == 0?
+                                prefs._SSIM : prefs._PHASH;
+    if(parser.isSet(threshold))             //same as threshold slider of main window
+    {
+        prefs._thresholdSSIM = parser.value(threshold).toInt() / 100.0;
+        prefs._thresholdPhash = static_cast<int>(round(64 * prefs._thresholdSSIM));
+    }
+    if(parser.isSet(blockSize))
+        prefs._ssimBlockSize = qBound(2, parser.value(blockSize).toInt(), 16);
+    if(parser.isSet(sameDuration))
+        prefs._sameDurationModifier = parser.value(sameDuration).toInt();
+    if(parser.isSet(differentDuration))
+        prefs._differentDurationModifier = parser.value(differentDuration).toInt();
+    if(parser.isSet(capture))
+    {
+        const QString engine = parser.value(capture).toLower();
+        prefs._captureMode = engine == QLatin1String("ffmpeg")? prefs._FFMPEG :
+                             engine == QLatin1String("pipe")? prefs._PIPE : prefs._OPENCV;
+    }
+    prefs._keyframeSeek = parser.isSet(fastSeek);
+    prefs._contentIds = parser.isSet(contentIds);
+    prefs._skipUnchangedFolders = parser.isSet(skipUnchanged);
+
+    QStringList folders;
+    for(const auto &folder : parser.positionalArguments())
+        if(QDir(folder).exists())
+            folders << QDir(folder).path();
+        else
+            err << "Cannot find folder: " << QDir::toNativeSeparators(folder) << Qt::endl;
+    if(folders.isEmpty())
+        parser.showHelp(1);
+
+    QStringList extensions;
+    for(const auto &line : DirWalker::readExtensions())
+        extensions << line.split(QStringLiteral(" "));
+    if(extensions.isEmpty())
+    {
+        err << "Error: extensions.ini not found. No video file will be searched." << Qt::endl;
+        return 1;
+    }
+
+    Headless search(prefs);
+    return search.search(folders, extensions);
+}
+
+int Headless::search(const QStringList &folders, const QStringList &extensions)
+{
+    Db::forThread().createTables();
+
+    DirWalker walker(extensions, _prefs._skipUnchangedFolders);
+    connect(&walker, &DirWalker::foundVideos, this, &Headless::addFoundVideos);
+    QEventLoop waitForWalker;
+    connect(&walker, &DirWalker::finished, &waitForWalker, &QEventLoop::quit);
+    walker.walk(DirWalker::normalizeRoots(folders));
+    waitForWalker.exec();
+    _err << "Found " << _everyVideo.count() << " video file(s)" << Qt::endl;
+
+    _prefs._numberOfVideos = static_cast<int>(_everyVideo.count());
+    Ingest ingest(_prefs, _everyVideo.values());
+    QEventLoop waitForIngest;                       //matches are written as videos arrive
+    connect(&ingest, &Ingest::finished, &waitForIngest, &QEventLoop::quit);
+    ingest.start();
+    waitForIngest.exec();
+    QCoreApplication::processEvents();              //process signals from last threads
+    CacheWriter::instance().flush();
+    CacheWriter::instance().stop();
+
+    _err << _videoList.count() << " intact video(s) out of " << _everyVideo.count() << " total, "
+         << _rejected << " could not be added due to errors, " << _matches << " matching pair(s)" << Qt::endl;
+    return 0;
+}
+
+void Headless::addFoundVideos(const QString &folder, const QStringList &filenames, const QVector<QDateTime> &modified)
+{
+    Q_UNUSED(folder)
+    for(int i=0; i<filenames.count(); i++)
+    {
+        const QString uniqueId = Db::uniqueId(filenames[i], modified[i], "");
+        if(_everyVideo.contains(uniqueId))          //don't want duplicates of same file
+            continue;
+        Video *video = new Video(_prefs, filenames[i], modified[i]);
+        connect(video, &Video::rejectVideo, this, &Headless::removeVideo);
+        connect(video, &Video::acceptVideo, this, &Headless::addVideo);
+        _everyVideo[uniqueId] = video;
+    }
+}
+
+void Headless::addVideo(Video *addMe)
+{
+    const int added = _store.add(*addMe);
+    const int hashes = _store.hashesPerVideo();
+    std::vector<uint8_t> distances(static_cast<size_t>(added) * hashes);
+    std::vector<uint8_t> closest(added, UINT8_MAX);
+    for(int h=0; h<hashes; h++)                             //pHashes of every video processed before in one pass
+    {
+        PhashKernel::distances(_store.hash(added, h), _store.hashes(), added * hashes, distances.data());
+        for(int i=0; i<added * hashes; i++)
+            closest[i / hashes] = qMin(closest[i / hashes], distances[i]);
+    }
+
+    const int maxDistance = _matcher.maxPhashDistance(_matcher.minPhashSimilarity());
+    for(int i=0; i<added; i++)
+    {
+        if(closest[i] > maxDistance)                        //can't match, SSIM is not needed either
+            continue;
+        const Video *video = _videoList[i];
+        const MatchScore score = _matcher.compare(_store, i, added);
+        if(!score.match)
+            continue;
+        QJsonObject match {
+            { QStringLiteral("left"), QDir::toNativeSeparators(video->filename) },
+            { QStringLiteral("right"), QDir::toNativeSeparators(addMe->filename) },
+            { QStringLiteral("phash"), score.phash } };
+        if(_prefs._comparisonMode == _prefs._SSIM)
+            match.insert(QStringLiteral("ssim"), qMin(score.ssim, 1.0));
+        _out << QJsonDocument(match).toJson(QJsonDocument::Compact) << Qt::endl;    //endl flushes line right away
+        _matches++;
+    }
+    _videoList << addMe;
+}
+
+void Headless::removeVideo(Video *deleteMe, const QString &reason)
+{
+    _err << "ERROR reading " << QDir::toNativeSeparators(deleteMe->filename) << ": " << reason << Qt::endl;
+    _rejected++;
+}
@@ -0,0 +1,40 @@
+#ifndef HEADLESS_H
+#define HEADLESS_H
+
+#include <QTextStream>
+#include "matcher.h"
+
+//finds duplicates without any window: folders, thumbnail mode, comparison mode and thresholds come from command line.
+//matching videos are written to stdout as JSON Lines while videos are still being processed, everything else to stderr
+class Headless : public QObject
+{
+    Q_OBJECT
+
+public:
+    //parses arguments of "vidupe --headless", returns exit code
+    static int run(const QCoreApplication &app);
+
+private:
+    explicit Headless(const Prefs &prefsParam) : _prefs(prefsParam), _matcher(_prefs),
+        _store(prefsParam._thumbnails == cutEnds? 16 : 1, prefsParam._ssimBlockSize) { }
+    ~Headless() { qDeleteAll(_everyVideo); }
+
+    Prefs _prefs;
+    const Matcher _matcher;
+    FingerprintStore _store;                        //of accepted videos, same order as _videoList
+    QHash<QString, Video *> _everyVideo;
+    QVector<Video *> _videoList;
+    int _rejected = 0;
+    int _matches = 0;
+    QTextStream _out { stdout };
+    QTextStream _err { stderr };
+
+    int search(const QStringList &folders, const QStringList &extensions);
+
+private slots:
+    void addFoundVideos(const QString &folder, const QStringList &filenames, const QVector<QDateTime> &modified);
+    void addVideo(Video *addMe);
+    void removeVideo(Video *deleteMe, const QString &reason);
+};
+
+#endif // HEADLESS_H
@@ -0,0 +1,101 @@
+#include "ingest.h"
+#include "cachewriter.h"
+
+Ingest::Ingest(const Prefs &prefs, const QVector<Video *> &videos)
+    : _prefs(prefs), _videos(videos),
+      _probeThreads(qMax(2, QThread::idealThreadCount())),            //mostly waiting for disk
+      _captureThreads(qMax(2, QThread::idealThreadCount())),          //decoding, also waits for disk
+      _toProbe(prefs._cacheLoadPageSize),
+      _toCapture(_captureThreads * 2)
+{
+    _pool.setMaxThreadCount(1 + _probeThreads + _captureThreads);
+}
+
+void Ingest::start()
+{
+    _probing = _probeThreads;
+    _capturing = _captureThreads;
+
+    _pool.start([this]() { prefetch(); });
+    for(int i=0; i<_probeThreads; i++)
+        _pool.start([this]() { probeStage(); });
+    for(int i=0; i<_captureThreads; i++)
+        _pool.start([this]() { captureStage(); });
+}
+
+void Ingest::prefetch()
+{
+    const Db &cache = Db::forThread();
+    const QVector<int> percentages = Thumbnail(_prefs._thumbnails).percentages();
+    int i = 0;
+    for(; i<_videos.count() && !_stopped; i+=_prefs._cacheLoadPageSize)
+    {
+        const QVector<Video *> batch = _videos.mid(i, _prefs._cacheLoadPageSize);
+        if(_prefs._contentIds)                                      //cache is found even if videos were renamed or moved
+            for(const auto &row : cache.resolveContentIds(batch))
+                CacheWriter::instance().writePath(row);
+        cache.populateMetadatas(batch);
+        QVector<Video *> cached;
+        for(const auto &video : batch)
+            if(video->cachedMetadata)
+                cached << video;
+        CacheWriter::instance().writeAccessTime(cached);
+
+        cache.populateFingerprints(batch, Db::fingerprintMode(_prefs._thumbnails, _prefs._keyframeSeek));  //one query,
+        QVector<Video *> notFingerprinted;                          //then screen captures of videos that need them
+        for(const auto &video : batch)
+            if(!video->cachedFingerprint)
+                notFingerprinted << video;
+        cache.populateCaptures(notFingerprinted, percentages, _prefs._keyframeSeek);
+
+        for(const auto &video : batch)
+            _toProbe.push(video);           //waits while probe stage is a whole batch behind
+    }
+    _skipped += qMax(0, static_cast<int>(_videos.count()) - i);        //stopped before they were looked up
+    _toProbe.close();
+}
+
+void Ingest::probeStage()
+{
+    Video *video;
+    while(_toProbe.pop(video))
+    {
+        if(_stopped)
+            _skipped++;
+        else if(video->probe())
+            _toCapture.push(video);
+    }
+    if(--_probing == 0)
+        _toCapture.close();
+}
+
+void Ingest::captureStage()
+{
+    Video *video;
+    while(_toCapture.pop(video))
+    {
+        if(_stopped)
+        {
+            _skipped++;
+            continue;
+        }
+        const int megabytes = captureMegabytes(*video);
+        _captureMemory.acquire(megabytes);          //waits while other large thumbnails are in memory
+        QImage thumbnail;
+        if(video->capture(thumbnail))
+            video->fingerprint(thumbnail);
+        thumbnail = QImage();
+        _captureMemory.release(megabytes);
+    }
+    if(--_capturing == 0)
+        emit finished();
+}
+
+int Ingest::captureMegabytes(const Video &video) const
+{
+    if(video.cachedFingerprint)
+        return 1;
+    Thumbnail thumb(_prefs._thumbnails);
+    const int64_t bytes = static_cast<int64_t>(thumb.cols()) * video.width * thumb.rows() * video.height * 3;
+    return static_cast<int>(qBound(int64_t(1), bytes / (1024 * 1024) + 1, int64_t(_captureMemoryMB)));
+}
@@ -0,0 +1,104 @@
+#ifndef INGEST_H
+#define INGEST_H
+
+#include <QObject>
+#include <QMutex>
+#include <QQueue>
+#include <QSemaphore>
+#include <QThreadPool>
+#include <QWaitCondition>
+#include <atomic>
+#include "video.h"
+
+//queue of limited size: producers wait while it is full and consumers wait while it is empty, nobody spins
+template <typename T>
+class BoundedQueue
+{
+public:
+    explicit BoundedQueue(const int &capacity) : _capacity(capacity) { }
+
+    void push(T item)
+    {
+        QMutexLocker locker(&_mutex);
+        while(_items.count() >= _capacity)
+            _notFull.wait(&_mutex);
+        _items.enqueue(std::move(item));
+        _notEmpty.wakeOne();
+    }
+
+    //returns false once queue is closed and empty
+    bool pop(T &item)
+    {
+        QMutexLocker locker(&_mutex);
+        while(_items.isEmpty() && !_closed)
+            _notEmpty.wait(&_mutex);
+        if(_items.isEmpty())
+            return false;
+        item = _items.dequeue();
+        _notFull.wakeOne();
+        return true;
+    }
+
+    //nothing more will be pushed
+    void close()
+    {
+        QMutexLocker locker(&_mutex);
+        _closed = true;
+        _notEmpty.wakeAll();
+    }
+
+private:
+    const int _capacity;
+    QMutex _mutex;
+    QWaitCondition _notFull;
+    QWaitCondition _notEmpty;
+    QQueue<T> _items;
+    bool _closed = false;
+};
+
+//processes videos in a pipeline of stages connected by bounded queues, each stage with its own number of threads:
+//cache lookup -> probe (reading properties) -> capture (decoding) and fingerprint (hashing) -> CacheWriter (persist).
+//workers of a stage take the next video from a shared queue, so slow videos don't hold up the others
+class Ingest : public QObject
+{
+    Q_OBJECT
+
+public:
+    Ingest(const Prefs &prefs, const QVector<Video *> &videos);
+    ~Ingest() { stop(); _pool.waitForDone(); }
+
+    //returns immediately, finished() is emitted after every video was accepted, rejected or skipped
+    void start();
+
+    //videos not yet processed are skipped
+    void stop() { _stopped = true; }
+    int skipped() const { return _skipped; }            //neither accepted nor rejected because of stop()
+
+private:
+    void prefetch();
+    void probeStage();
+    void captureStage();                                //thumbnail is hashed right away, so it is only held once
+    int captureMegabytes(const Video &video) const;     //memory of full size thumbnail while it is captured
+
+    static constexpr int _captureMemoryMB = 1024;       //thumbnails being captured at the same time take at most this
+
+    const Prefs _prefs;
+    const QVector<Video *> _videos;
+    const int _probeThreads;
+    const int _captureThreads;
+
+    QThreadPool _pool;
+    QSemaphore _captureMemory { _captureMemoryMB };     //fewer videos are captured at once if they are large
+    std::atomic<bool> _stopped { false };
+    std::atomic<int> _skipped { 0 };
+    std::atomic<int> _probing { 0 };                    //threads still running in each stage, last one closes
+    std::atomic<int> _capturing { 0 };                  //queue of next stage or reports that ingest is finished
+
+    BoundedQueue<Video *> _toProbe;
+    BoundedQueue<Video *> _toCapture;
+
+signals:
+    void finished();
+};
+
+#endif // INGEST_H
@@ -0,0 +1,51 @@
+#ifndef LOCKFREEQUEUE_H
+#define LOCKFREEQUEUE_H
+
+#include <QVector>
+#include <algorithm>
+#include <atomic>
+
+//many threads push, one thread takes everything pushed so far at once. pushing never blocks or waits for a lock:
+//items are linked onto a stack with compare-and-swap, and taking all swaps the whole stack out in one step
+template <typename T>
+class LockFreeQueue
+{
+public:
+    LockFreeQueue() = default;
+    LockFreeQueue(const LockFreeQueue &) = delete;
+    LockFreeQueue &operator=(const LockFreeQueue &) = delete;
+    ~LockFreeQueue() { takeAll(); }
+
+    void push(T value)
+    {
+        Node *node = new Node { std::move(value), _head.load(std::memory_order_relaxed) };
+        while(!_head.compare_exchange_weak(node->next, node, std::memory_order_release, std::memory_order_relaxed))
+            ;
+    }
+
+    //items in the order they were pushed
+    QVector<T> takeAll()
+    {
+        Node *node = _head.exchange(nullptr, std::memory_order_acquire);
+        QVector<T> items;
+        while(node)
+        {
+            items << std::move(node->value);
+            Node *next = node->next;
+            delete node;
+            node = next;
+        }
+        std::reverse(items.begin(), items.end());       //stack is newest first
+        return items;
+    }
+
+private:
+    struct Node
+    {
+        T value;
+        Node *next;
+    };
+    std::atomic<Node *> _head { nullptr };
+};
+
+#endif // LOCKFREEQUEUE_H
@@ -1,12 +1,27 @@
-#include <QDirIterator>
+#include <QEventLoop>
 #include <QFileDialog>
+#include <QInputDialog>
 #include <QScrollBar>
-#include <QtConcurrent/QtConcurrentRun>
+#include <QThreadPool>
+#include <QTimer>
 #include "mainwindow.h"
 #include "comparison.h"
+#include "cachewriter.h"
+#include "dirwalker.h"
+#include "headless.h"
+#include "ingest.h"
 
 int main(int argc, char *argv[])
 {
+    for(int i=1; i<argc; i++)
+        if(qstrcmp(argv[i], "--headless") == 0)     //no window, no display needed
+        {
+            QCoreApplication a(argc, argv);
+            QCoreApplication::setApplicationName(APP_NAME);
+            QCoreApplication::setApplicationVersion(APP_VERSION);
+            return Headless::run(a);
+        }
+
     QApplication a(argc, argv);
     MainWindow w;
     w.show();
@@ -36,6 +51,8 @@ MainWindow::MainWindow() : ui(new Ui::MainWindow)
     for(int i=0; i<thumb.countModes(); i++)
         ui->selectThumbnails->addItem(thumb.modeName(i));
     ui->selectThumbnails->setCurrentIndex(7);
+    ui->selectCapture->addItems( { QStringLiteral("OpenCV"), QStringLiteral("FFmpeg"), QStringLiteral("FFmpeg pipe") } );
+    ui->selectCapture->setCurrentIndex(_prefs._captureMode);
 
     for(int i=0; i<=5; i++)
     {
@@ -52,6 +69,13 @@ MainWindow::MainWindow() : ui(new Ui::MainWindow)
     ui->mainToolBar->setVisible(false);
 }
 
+MainWindow::~MainWindow()
+{
+    CacheWriter::instance().stop();     //commit all pending cache writes before exit
+    deleteTemporaryFiles();
+    delete ui;
+}
+
 void MainWindow::deleteTemporaryFiles() const
 {
     QDir tempDir = QDir::tempPath();    //QTemporaryDir remains if program force quit
@@ -75,25 +99,18 @@ void MainWindow::dropEvent(QDropEvent *event)
 
 void MainWindow::loadExtensions()
 {
-    QFile file(QStringLiteral("%1/extensions.ini").arg(QApplication::applicationDirPath()));
-    if(!file.open(QIODevice::ReadOnly))
+    const QStringList lines = DirWalker::readExtensions();
+    if(lines.isEmpty())
     {
         addStatusMessage(QStringLiteral("Error: extensions.ini not found. No video file will be searched."));
         return;
     }
     addStatusMessage(QStringLiteral("Supported file extensions:"));
-    QTextStream text(&file);
-    while(!text.atEnd())
+    for(QString line : lines)
     {
-        QString line = text.readLine();
-        if(line.startsWith(QStringLiteral(";")) || line.isEmpty())
-            continue;
-
-        static QRegularExpression regex("\\*?\\.");
-        _extensionList << line.replace(regex, "*.").split(QStringLiteral(" "));
+        _extensionList << line.split(QStringLiteral(" "));
         addStatusMessage(line.remove(QStringLiteral("*")));
     }
-    file.close();
 }
 
 void MainWindow::loadLocations()
@@ -161,6 +178,10 @@ void MainWindow::on_findDuplicates_clicked()
     if(ui->findDuplicates->text() == QLatin1String("Stop"))     //pressing "find duplicates" button will morph into a
     {                                                           //stop button. a lengthy search can thus be stopped and
         _userPressedStop = true;                                //those videos already processed are compared w/each other
+        if(_walker)
+            _walker->stop();
+        if(_ingest)
+            _ingest->stop();
         return;
     }
     else
@@ -176,8 +197,10 @@ void MainWindow::on_findDuplicates_clicked()
     if(!detectffmpeg())
         return;
 
-    const QString foldersToSearch = ui->directoryBox->text();   //search only if folder or thumbnail settings have changed
-    if(foldersToSearch != _previousRunFolders || _prefs._thumbnails != _previousRunThumbnails)
+    const QString foldersToSearch = ui->directoryBox->text();   //search only if folder, thumbnail or seek settings changed
+    const bool newSearch = foldersToSearch != _previousRunFolders || _prefs._thumbnails != _previousRunThumbnails ||
+                           _prefs._keyframeSeek != _previousRunKeyframeSeek;
+    if(newSearch)
     {
         ui->statusBox->append(QStringLiteral("\nSearching for videos..."));
         ui->statusBar->setVisible(true);
@@ -186,8 +209,13 @@ void MainWindow::on_findDuplicates_clicked()
             delete video;
         _videoList.clear();
         _everyVideo.clear();
+        _store = FingerprintStore(_prefs._thumbnails == cutEnds? 16 : 1, _prefs._ssimBlockSize);
+        _fingerprintMode = Db::fingerprintMode(_prefs._thumbnails, _prefs._keyframeSeek);
 
+        runInBackground([]() { Db::forThread().createTables(); });  //folder listings are also cached, and
+                                                                     //migrating an older cache can take long
         const QStringList directories = foldersToSearch.split(QStringLiteral(";"));
+        QStringList existing;
         QString notFound;
         for(auto directory : directories)               //add all video files from entered paths to list
         {
@@ -195,13 +223,14 @@ void MainWindow::on_findDuplicates_clicked()
                 continue;
             QDir dir = directory.remove(QStringLiteral("\""));
             if(dir.exists())
-                findVideos(dir);
+                existing << dir.path();
             else
             {
                 addStatusMessage(QStringLiteral("Cannot find folder: %1").arg(QDir::toNativeSeparators(dir.path())));
                 notFound += QStringLiteral("%1 ").arg(QDir::toNativeSeparators(dir.path()));
             }
         }
+        findVideos(existing);
         if(!notFound.isEmpty())
             ui->statusBar->showMessage(QStringLiteral("Cannot find folder: %1").arg(notFound));
 
@@ -210,57 +239,103 @@ void MainWindow::on_findDuplicates_clicked()
 
     if(_videoList.count() > 1)
     {
-        Comparison comparison(_videoList, _prefs);
-        if(foldersToSearch != _previousRunFolders || _prefs._thumbnails != _previousRunThumbnails)
-        {
-            QFuture<void> future = QtConcurrent::run(std::bind(&Comparison::reportMatchingVideos, &comparison));   //run in background
-            comparison.exec();          //open dialog, but if it is closed while reportMatchingVideos() still running...
-            QApplication::setOverrideCursor(Qt::WaitCursor);
-            future.waitForFinished();   //...must wait until finished (crash when going out of scope destroys instance)
-            QApplication::restoreOverrideCursor();
-        }
-        else
-            comparison.exec();
+        _store.setBlockSize(_prefs._ssimBlockSize);     //may have changed since videos were added
+        Comparison comparison(_videoList, _store, _fingerprintMode, _prefs);  //finds all matching pairs before it opens
+        if(newSearch)
+            comparison.reportMatchingVideos();
+        comparison.exec();
 
         _previousRunFolders = foldersToSearch;                  //videos are still held in memory until
-        _previousRunThumbnails = _prefs._thumbnails;            //folders to search or thumbnail mode are changed
+        _previousRunThumbnails = _prefs._thumbnails;            //folders to search, thumbnail or seek mode are changed
+        _previousRunKeyframeSeek = _prefs._keyframeSeek;
     }
 
     ui->findDuplicates->setText(QStringLiteral("Find duplicates"));
 }
 
-void MainWindow::findVideos(QDir &dir)
+void MainWindow::on_actionCleanCache_triggered()
 {
-    dir.setNameFilters(_extensionList);
-    QDirIterator iter(dir, QDirIterator::Subdirectories);
-    while(iter.hasNext())
+    if(ui->findDuplicates->text() == QLatin1String("Stop"))
     {
-        if(_userPressedStop)
-            return;
-        const QFile file(iter.next());
-        const QString filename = file.fileName();
-        const QFileInfo fileInfo(filename);
-
-        const QDateTime dateMod = fileInfo.lastModified();
-        Video *video = new Video(_prefs, filename, dateMod);
-        const QString uniqueId = video->id;
-
-//        bool duplicate = false;                 //don't want duplicates of same file
-        if(!_everyVideo.contains(uniqueId)){
-            _everyVideo[uniqueId] = video;
-        }
-//        for(const auto &alreadyAddedFile : _everyVideo.keys())
-//            if(uniqueId.toLower() == alreadyAddedFile.toLower())
-//            {
-//                duplicate = true;
-//                break;
-//            }
-//        if(!duplicate)
+        addStatusMessage(QStringLiteral("Cache can be cleaned up after searching for videos has finished"));
+        return;
+    }
+    bool ok = false;
+    const int limit = QInputDialog::getInt(this, QStringLiteral("Clean up cache"),
+                                           QStringLiteral("Remove videos that were deleted, moved or modified.\n"
+                                                          "Maximum cache size in MB (0 = no limit):"),
+                                           _prefs._cacheSizeLimit, 0, INT_MAX, 100, &ok);
+    if(!ok)
+        return;
+    _prefs._cacheSizeLimit = limit;
+
+    ui->statusBox->append(QStringLiteral("\nCleaning up cache..."));
+    ui->findDuplicates->setDisabled(true);
+    ui->actionCleanCache->setDisabled(true);
+    int64_t sizeBefore = 0;
+    int64_t sizeAfter = 0;
+    int stale = 0;
+    int evicted = 0;
+    runInBackground([&]()
+    {
+        CacheWriter::instance().flush();
+        const Db &cache = Db::forThread();
+        cache.createTables();                       //cache of older version may lack tables and columns used here
+        sizeBefore = cache.usedBytes();
+        stale = cache.removeStaleVideos();
+        evicted = limit? cache.evictLeastRecentlyUsed(static_cast<int64_t>(limit) * 1024 * 1024) : 0;
+        cache.compact();
+        sizeAfter = cache.usedBytes();
+    });
+    ui->findDuplicates->setDisabled(false);
+    ui->actionCleanCache->setDisabled(false);
+
+    addStatusMessage(QStringLiteral("Removed %1 deleted or modified and %2 least recently used video(s) from cache, "
+                                    "size %3 MB -> %4 MB").arg(stale).arg(evicted)
+                     .arg(sizeBefore / (1024 * 1024)).arg(sizeAfter / (1024 * 1024)));
+}
+
+void MainWindow::runInBackground(const std::function<void()> &work) const
+{
+    QEventLoop waitForWork;
+    QThreadPool worker;
+    worker.start([&]()
+    {
+        work();
+        QMetaObject::invokeMethod(&waitForWork, &QEventLoop::quit, Qt::QueuedConnection);
+    });
+    waitForWork.exec();                             //work is done in other thread, GUI (and stop button) still work
+    worker.waitForDone();
+}
 
+void MainWindow::findVideos(const QStringList &folders)
+{
+    DirWalker walker(_extensionList, _prefs._skipUnchangedFolders);
+    connect(&walker, &DirWalker::foundVideos, this, &MainWindow::addFoundVideos);
+    QEventLoop waitForWalker;
+    connect(&walker, &DirWalker::finished, &waitForWalker, &QEventLoop::quit);
+
+    _walker = &walker;
+    walker.walk(DirWalker::normalizeRoots(folders));
+    waitForWalker.exec();                           //folders are listed in other threads, GUI (and stop button) still work
+    _walker = nullptr;
+}
 
-        ui->statusBar->showMessage(QDir::toNativeSeparators(filename), 10);
-        QApplication::processEvents();
+void MainWindow::addFoundVideos(const QString &folder, const QStringList &filenames, const QVector<QDateTime> &modified)
+{
+    for(int i=0; i<filenames.count(); i++)
+    {
+        const QString uniqueId = Db::uniqueId(filenames[i], modified[i], "");
+        if(_everyVideo.contains(uniqueId))          //don't want duplicates of same file
+            continue;
+        Video *video = new Video(_prefs, filenames[i], modified[i]);
+        connect(video, &Video::rejectVideo, this, [this](Video *deleteMe, const QString &reason) {
+            _results.push({ deleteMe, reason }); }, Qt::DirectConnection);     //called in worker thread
+        connect(video, &Video::acceptVideo, this, [this](Video *addMe) {
+            _results.push({ addMe, QString() }); }, Qt::DirectConnection);
+        _everyVideo[uniqueId] = video;
     }
+    ui->statusBar->showMessage(QDir::toNativeSeparators(folder), 10);
 }
 
 void MainWindow::processVideos()
@@ -281,29 +356,23 @@ void MainWindow::processVideos()
     }
     else return;
 
-    Db setup("main");
-    setup.createTables();
-
-    setup.populateMetadatas(_everyVideo);
-//Do batch cache retrieval here eventually
-    QThreadPool threadPool;
+    Ingest ingest(_prefs, _everyVideo.values());
+    QEventLoop waitForIngest;
+    connect(&ingest, &Ingest::finished, &waitForIngest, &QEventLoop::quit);
 
-    for(const auto &videoTask : std::as_const(_everyVideo))
-    {
-        if(_userPressedStop)
-        {
-            threadPool.clear();
-            break;
-        }
-        while(threadPool.activeThreadCount() == threadPool.maxThreadCount())
-            QApplication::processEvents();          //avoid blocking signals in event loop
+    QTimer refresh;                                 //results are shown at fixed rate, not once per video
+    connect(&refresh, &QTimer::timeout, this, &MainWindow::showResults);
+    refresh.start(_resultIntervalMs);
 
-        //auto *videoTask = _everyVideo[filename];
-        videoTask->setAutoDelete(false);
-        threadPool.start(videoTask);
-    }
-    threadPool.waitForDone();
-    QApplication::processEvents();                  //process signals from last threads
+    _ingest = &ingest;
+    ingest.start();
+    waitForIngest.exec();                           //videos are processed in other threads, GUI only receives results
+    _ingest = nullptr;
+    refresh.stop();
+    showResults();                                  //results of last videos
+    CacheWriter::instance().flush();                //everything processed so far is in cache even if stopped
+    if(ingest.skipped())
+        addStatusMessage(QStringLiteral("%1 video(s) skipped because processing was stopped").arg(ingest.skipped()));
 
     ui->selectThumbnails->setDisabled(false);
     ui->processedFiles->setVisible(false);
@@ -335,23 +404,34 @@ void MainWindow::addStatusMessage(const QString &message) const
     ui->statusBox->repaint();
 }
 
-void MainWindow::addVideo(Video *addMe)
+void MainWindow::showResults()
 {
-    addStatusMessage(QStringLiteral("[%1] %2 - %3 - %4")
-        .arg(QTime::currentTime().toString(), QDir::toNativeSeparators(addMe->filename))
-        .arg( addMe->cachedMetadata)
-        .arg( addMe->cachedCaptures));
-    ui->progressBar->setValue(ui->progressBar->value() + 1);
-    ui->processedFiles->setText(QStringLiteral("%1/%2").arg(ui->progressBar->value()).arg(ui->progressBar->maximum()));
-    _videoList << addMe;
-}
+    const QVector<VideoResult> results = _results.takeAll();
+    if(results.isEmpty())
+        return;
 
-void MainWindow::removeVideo(Video *deleteMe, const QString &reason)
-{
-    addStatusMessage(QStringLiteral("[%1] ERROR reading %2: %3").arg(
-        QTime::currentTime().toString(), QDir::toNativeSeparators(deleteMe->filename), reason));
-    ui->progressBar->setValue(ui->progressBar->value() + 1);
+    QStringList messages;
+    for(const auto &result : results)
+    {
+        Video *video = result.video;
+        if(result.rejectReason.isNull())
+        {
+            messages << QStringLiteral("[%1] %2 - %3 - %4")
+                .arg(QTime::currentTime().toString(), QDir::toNativeSeparators(video->filename))
+                .arg( video->cachedMetadata)
+                .arg( video->cachedCaptures);
+            _store.add(*video);
+            _videoList << video;
+        }
+        else
+        {
+            messages << QStringLiteral("[%1] ERROR reading %2: %3").arg(
+                QTime::currentTime().toString(), QDir::toNativeSeparators(video->filename), result.rejectReason);
+            _rejectedVideos << QDir::toNativeSeparators(video->filename);
+            delete video;
+        }
+    }
+    ui->statusBox->append(messages.join(QStringLiteral("\n")));      //one append and one repaint for all videos
+    ui->progressBar->setValue(ui->progressBar->value() + static_cast<int>(results.count()));
     ui->processedFiles->setText(QStringLiteral("%1/%2").arg(ui->progressBar->value()).arg(ui->progressBar->maximum()));
-    _rejectedVideos << QDir::toNativeSeparators(deleteMe->filename);
-    delete deleteMe;
 }
@@ -3,10 +3,14 @@
 
 #include <QDragEnterEvent>
 #include <QMimeData>
+#include <functional>
 #include "ui_mainwindow.h"
-#include "video.h"
+#include "fingerprintstore.h"
+#include "lockfreequeue.h"
 
 namespace Ui { class MainWindow; }
+class DirWalker;
+class Ingest;
 
 class MainWindow : public QMainWindow
 {
@@ -14,7 +18,7 @@ class MainWindow : public QMainWindow
 
 public:
     MainWindow();
-    ~MainWindow() { deleteTemporaryFiles(); delete ui; }
+    ~MainWindow();
 
 private:
     Ui::MainWindow *ui;
@@ -25,9 +29,12 @@ private:
     QStringList _extensionList;
 
     Prefs _prefs;
+    FingerprintStore _store { 1, _prefs._ssimBlockSize };  //of _videoList in same order, only copy of ssim thumbnails
     bool _userPressedStop = false;
     QString _previousRunFolders;
     int _previousRunThumbnails = -1;
+    bool _previousRunKeyframeSeek = false;
+    int _fingerprintMode = -1;                      //of cache rows videos in _videoList were ingested with
 
     void deleteTemporaryFiles() const;
     bool detectffmpeg() const;
@@ -37,7 +44,21 @@ private:
 
     void calculateThreshold(const int &value);
 
-    void findVideos(QDir &dir);
+    DirWalker *_walker = nullptr;                   //while searching folders
+    Ingest *_ingest = nullptr;                      //while processing videos
+
+    struct VideoResult
+    {
+        Video *video;
+        QString rejectReason;                       //null if video was accepted
+    };
+    LockFreeQueue<VideoResult> _results;            //filled by worker threads, emptied by showResults()
+    static constexpr int _resultIntervalMs = 100;
+
+    void showResults();
+
+    void runInBackground(const std::function<void()> &work) const;   //returns when work is done
+    void findVideos(const QStringList &folders);
     void processVideos();
     void videoSummary();
 
@@ -47,8 +68,7 @@ private:
 
 public slots:
     void addStatusMessage(const QString &message) const;
-    void addVideo(Video *addMe);
-    void removeVideo(Video *deleteMe, const QString &reason);
+    void addFoundVideos(const QString &folder, const QStringList &filenames, const QVector<QDateTime> &modified);
     void setComparisonMode(const int &mode) { if(mode == _prefs._PHASH) ui->selectPhash->click(); else ui->selectSSIM->click(); ui->directoryBox->setFocus(); }
     void on_thresholdSlider_valueChanged(const int &value) { ui->thresholdSlider->setValue(value); calculateThreshold(value); ui->directoryBox->setFocus(); }
     void on_thresholdSliderMax_valueChanged(const int &value) { ui->thresholdSlider->setMaximum(value); }
@@ -56,6 +76,8 @@ public slots:
 private slots:
     void on_selectThumbnails_activated(const int &index) { ui->directoryBox->setFocus(); _prefs._thumbnails = index;
                                                            if(_prefs._thumbnails == cutEnds) ui->differentDurationCombo->setCurrentIndex(0); }
+    void on_selectCapture_activated(const int &index) { _prefs._captureMode = index; ui->directoryBox->setFocus(); }
+    void on_keyframeSeek_clicked(const bool &checked) { _prefs._keyframeSeek = checked; ui->directoryBox->setFocus(); }
     void on_selectPhash_clicked(const bool &checked) { if(checked) _prefs._comparisonMode = _prefs._PHASH; ui->directoryBox->setFocus(); }
     void on_selectSSIM_clicked(const bool &checked) { if(checked) _prefs._comparisonMode = _prefs._SSIM; ui->directoryBox->setFocus(); }
     void on_blocksizeCombo_activated(const int &index) { _prefs._ssimBlockSize = static_cast<int>(pow(2, index+1)); ui->directoryBox->setFocus(); }
@@ -63,6 +85,9 @@ private slots:
     void on_sameDurationCombo_activated(const int &index) { _prefs._sameDurationModifier = index; ui->directoryBox->setFocus(); }
 
     void on_browseFolders_clicked() const;
+    void on_actionCleanCache_triggered();
+    void on_actionContentIds_toggled(const bool &checked) { _prefs._contentIds = checked; }
+    void on_actionSkipUnchangedFolders_toggled(const bool &checked) { _prefs._skipUnchangedFolders = checked; }
     void on_directoryBox_returnPressed() { on_findDuplicates_clicked(); }
     void on_findDuplicates_clicked();
 };
@@ -0,0 +1,70 @@
+#include "matcher.h"
+
+MatchScore Matcher::compare(const FingerprintStore &store, const int &left, const int &right) const
+{
+    return score(store, left, right, minPhashSimilarity(), true);
+}
+
+MatchScore Matcher::score(const FingerprintStore &store, const int &left, const int &right, const int &minPhash,
+                          const bool &stopWhenDecided) const
+{
+    MatchScore score;
+    const int modifier = durationModifier(store.duration(left), store.duration(right));
+
+    const int hashes = store.hashesPerVideo();
+    bool done = false;
+    for(int left_hash=0; left_hash<hashes && !done; left_hash++)
+        for(int right_hash=0; right_hash<hashes && !done; right_hash++)
+        {                           //if cutEnds mode: similarity is always the best one of all comparisons
+            const int phash = comparePhash(store.hash(left, left_hash), store.hash(right, right_hash), modifier);
+            score.phash = qMax(score.phash, phash);
+            if(_prefs._comparisonMode == _prefs._SSIM && phash >= minPhash)
+                score.ssim = qMax(score.ssim, ssim(store, left, left_hash, right, right_hash) + modifier / 64.0);
+            done = stopWhenDecided && decided(score, modifier);
+        }
+    score.match = matches(score);
+    return score;
+}
+
+bool Matcher::decided(const MatchScore &score, const int &durationModifier) const
+{
+    if(_prefs._comparisonMode == _prefs._PHASH)     //pHash similarity can't be more than 64 bits
+        return score.phash > _prefs._thresholdPhashMax || (matches(score) && _prefs._thresholdPhashMax >= 64);
+    return score.ssim > _prefs._thresholdSSIMMax ||
+           (matches(score) && _prefs._thresholdSSIMMax >= 1.0 + durationModifier / 64.0);
+}
+
+bool Matcher::matches(const MatchScore &score) const
+{
+    if(_prefs._comparisonMode == _prefs._PHASH)
+        return score.phash >= _prefs._thresholdPhash && score.phash <= _prefs._thresholdPhashMax;
+    return score.phash >= minPhashSimilarity() &&
+           score.ssim > _prefs._thresholdSSIM && score.ssim <= _prefs._thresholdSSIMMax;
+}
+
+int Matcher::minPhashSimilarity() const
+{
+    return _prefs._comparisonMode == _prefs._PHASH? _prefs._thresholdPhash : qMax(_prefs._thresholdPhash, _ssimMinPhash);
+}
+
+int Matcher::maxPhashDistance(const int &minSimilarity) const
+{
+    return 64 - minSimilarity + qMax(0, _prefs._sameDurationModifier);     //same duration makes pair more similar
+}
+
+int Matcher::durationModifier(const int64_t &leftDuration, const int64_t &rightDuration) const
+{
+    if( qAbs(leftDuration - rightDuration) <= 1000 )
+        return 0 + _prefs._sameDurationModifier;                //lower distance if both durations within 1s
+    return 0 - _prefs._differentDurationModifier;               //raise distance if both durations differ 1s
+}
+
+int Matcher::comparePhash(const uint64_t &leftHash, const uint64_t &rightHash, const int &durationModifier) const
+{
+    if(leftHash == 0 && rightHash == 0)
+        return 0;
+
+    int distance = 64 - qPopulationCount(leftHash ^ rightHash);     //XOR has ones for differing bits, count them
+    distance = distance + durationModifier;
+    return distance > 64? 64 : distance;
+}
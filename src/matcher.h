@@ -0,0 +1,47 @@
+#ifndef MATCHER_H
+#define MATCHER_H
+
+#include "fingerprintstore.h"
+
+struct MatchScore
+{
+    bool match = false;
+    int phash = 0;                          //identical bits of most similar hashes, duration modifier included
+    double ssim = 0.0;                      //only compared in SSIM mode when pHashes are close
+};
+
+//decides if two videos of a fingerprint store match with the thresholds in prefs, for comparison window and
+//headless mode. keeps no state between comparisons, so any number of threads can share one instance
+class Matcher
+{
+public:
+    explicit Matcher(const Prefs &prefsParam) : _prefs(prefsParam) { }
+
+    //same result as matches(score()) with minPhashSimilarity(), but stops as soon as remaining hashes can't change it
+    MatchScore compare(const FingerprintStore &store, const int &left, const int &right) const;
+
+    //similarity of most similar hashes. in SSIM mode, hashes at least minPhash similar are compared with SSIM too.
+    //match is set as with current thresholds
+    MatchScore score(const FingerprintStore &store, const int &left, const int &right, const int &minPhash,
+                     const bool &stopWhenDecided = false) const;
+    bool matches(const MatchScore &score) const;
+
+    static constexpr int _ssimMinPhash = 44;    //ssim comparison is slow, only do it if pHash differs at most 20 bits
+
+    int minPhashSimilarity() const;             //of matching videos with current thresholds
+    //videos whose pHashes differ in more bits than this can't be at least minSimilarity similar
+    int maxPhashDistance(const int &minSimilarity) const;
+
+private:
+    const Prefs &_prefs;
+
+    int durationModifier(const int64_t &leftDuration, const int64_t &rightDuration) const;
+    //true if more similar hashes can't change whether score matches anymore
+    bool decided(const MatchScore &score, const int &durationModifier) const;
+    int comparePhash(const uint64_t &leftHash, const uint64_t &rightHash, const int &durationModifier) const;
+
+    double ssim(const FingerprintStore &store, const int &left, const int &leftHash,
+                const int &right, const int &rightHash) const;
+};
+
+#endif // MATCHER_H
@@ -0,0 +1,72 @@
+#include "phashindex.h"
+
+PhashIndex::PhashIndex(const FingerprintStore &store)
+    : _videoCount(store.count()), _hashesPerVideo(store.hashesPerVideo()),
+      _hashCount(store.count() * store.hashesPerVideo()), _hashes(store.hashes())
+{
+    for(int c=0; c<_chunks; c++)                            //counting sort of hash positions by chunk value
+    {
+        QVector<int> &offsets = _offsets[c];
+        offsets.fill(0, _chunkValues + 1);
+        for(int i=0; i<_hashCount; i++)
+            offsets[chunk(_hashes[i], c) + 1]++;
+        for(int value=0; value<_chunkValues; value++)
+            offsets[value + 1] += offsets[value];
+
+        QVector<int> next(offsets.cbegin(), offsets.cend() - 1);
+        QVector<int> &positions = _positions[c];
+        positions.resize(_hashCount);
+        for(int i=0; i<_hashCount; i++)
+            positions[next[chunk(_hashes[i], c)]++] = i;
+    }
+
+    for(int value=0; value<_chunkValues; value++)
+        _masks[qPopulationCount(static_cast<quint32>(value))] << static_cast<uint16_t>(value);
+}
+
+QVector<int> PhashIndex::candidates(const int &left, const int &maxDistance) const
+{
+    QVector<int> result;
+    const int chunkDistance = qMin(qMax(0, maxDistance) / _chunks, _chunkBits);    //all chunk values beyond that
+    int lookups = 0;
+    for(int bits=0; bits<=chunkDistance; bits++)
+        lookups += static_cast<int>(_masks[bits].count());
+    if(static_cast<int64_t>(lookups) * _chunks * _hashesPerVideo >= static_cast<int64_t>(_videoCount - left - 1) * 4)
+    {                                                       //brute force is cheaper: all later hashes in one pass
+        const int first = (left + 1) * _hashesPerVideo;
+        const int count = _hashCount - first;
+        std::vector<uint8_t> distances(count);
+        std::vector<uint8_t> closest(_videoCount - left - 1, UINT8_MAX);
+        for(int h=0; h<_hashesPerVideo; h++)
+        {
+            PhashKernel::distances(_hashes[left * _hashesPerVideo + h], _hashes + first, count, distances.data());
+            for(int i=0; i<count; i++)
+                closest[i / _hashesPerVideo] = qMin(closest[i / _hashesPerVideo], distances[i]);
+        }
+        for(int right=left+1; right<_videoCount; right++)
+            if(closest[right - left - 1] <= maxDistance)
+                result << right;
+        return result;
+    }
+
+    for(int h=0; h<_hashesPerVideo; h++)
+    {
+        const uint64_t hash = _hashes[left * _hashesPerVideo + h];
+        for(int c=0; c<_chunks; c++)
+            for(int bits=0; bits<=chunkDistance; bits++)
+                for(const auto &mask : _masks[bits])
+                {
+                    const int value = chunk(hash, c) ^ mask;
+                    for(int i=_offsets[c][value]; i<_offsets[c][value + 1]; i++)
+                    {
+                        const int position = _positions[c][i];
+                        const int right = position / _hashesPerVideo;
+                        if(right > left && qPopulationCount(hash ^ _hashes[position]) <= maxDistance)
+                            result << right;
+                    }
+                }
+    }
+    std::sort(result.begin(), result.end());
+    result.erase(std::unique(result.begin(), result.end()), result.end());
+    return result;
+}
@@ -0,0 +1,36 @@
+#ifndef PHASHINDEX_H
+#define PHASHINDEX_H
+
+#include <QVector>
+#include <array>
+#include "fingerprintstore.h"
+
+//multi-index hashing: 64 bit pHashes are split into four 16 bit chunks and each chunk gets its own lookup table.
+//if two hashes differ in at most r bits, at least one of their chunks differs in at most r/4 bits, so only table
+//entries that close to each chunk need to be looked at instead of every other video
+class PhashIndex
+{
+public:
+    explicit PhashIndex(const FingerprintStore &store);    //store must not change while index is used
+
+    //videos after left (larger index) with a hash at most maxDistance bits from a hash of left, in ascending order.
+    //when thresholds are so low that looking up neighbours costs more than comparing, all later hashes are compared
+    QVector<int> candidates(const int &left, const int &maxDistance) const;
+
+private:
+    static constexpr int _chunks = 4;
+    static constexpr int _chunkBits = 16;
+    static constexpr int _chunkValues = 1 << _chunkBits;
+
+    int _videoCount;
+    int _hashesPerVideo;
+    int _hashCount;
+    const uint64_t *_hashes;                                //all hashes of all videos, one after another
+    std::array<QVector<int>, _chunks> _offsets;             //per chunk: where hashes with each chunk value start...
+    std::array<QVector<int>, _chunks> _positions;           //...in list of hash positions sorted by chunk value
+    std::array<QVector<uint16_t>, _chunkBits + 1> _masks;   //all 16 bit values with exactly n bits set
+
+    static uint16_t chunk(const uint64_t &hash, const int &c) { return static_cast<uint16_t>(hash >> (c * _chunkBits)); }
+};
+
+#endif // PHASHINDEX_H
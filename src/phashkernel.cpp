@@ -0,0 +1,117 @@
+#include <QtGlobal>
+#include "phashkernel.h"
+
+#if defined(__x86_64__) || defined(_M_X64)
+    #define PHASH_X86
+    #include <immintrin.h>
+    #if defined(_MSC_VER) && !defined(__clang__)
+        #include <intrin.h>
+        #define TARGET_AVX2
+        #define TARGET_AVX512
+    #else
+        #define TARGET_AVX2 __attribute__((target("avx2")))
+        #define TARGET_AVX512 __attribute__((target("avx512f,avx512vpopcntdq")))
+    #endif
+#endif
+
+namespace
+{
+    using Kernel = void (*)(const uint64_t &, const uint64_t *, const int &, uint8_t *);
+
+    void distancesScalar(const uint64_t &hash, const uint64_t *hashes, const int &count, uint8_t *out)
+    {
+        for(int i=0; i<count; i++)
+            out[i] = static_cast<uint8_t>(qPopulationCount(hash ^ hashes[i]));
+    }
+
+#ifdef PHASH_X86
+    TARGET_AVX2
+    void distancesAvx2(const uint64_t &hash, const uint64_t *hashes, const int &count, uint8_t *out)
+    {                                           //bits of each 4 bit nibble are looked up with a byte shuffle
+        const __m256i nibbleBits = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+                                                    0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+        const __m256i lowNibbles = _mm256_set1_epi8(0x0f);
+        const __m256i needle = _mm256_set1_epi64x(static_cast<long long>(hash));
+        int i = 0;
+        for(; i+4<=count; i+=4)
+        {
+            const __m256i differentBits = _mm256_xor_si256(
+                        _mm256_loadu_si256(reinterpret_cast<const __m256i *>(hashes + i)), needle);
+            const __m256i low = _mm256_shuffle_epi8(nibbleBits, _mm256_and_si256(differentBits, lowNibbles));
+            const __m256i high = _mm256_shuffle_epi8(nibbleBits,
+                                                     _mm256_and_si256(_mm256_srli_epi16(differentBits, 4), lowNibbles));
+            const __m256i sums = _mm256_sad_epu8(_mm256_add_epi8(low, high), _mm256_setzero_si256());   //per hash
+            out[i]     = static_cast<uint8_t>(_mm256_extract_epi64(sums, 0));
+            out[i + 1] = static_cast<uint8_t>(_mm256_extract_epi64(sums, 1));
+            out[i + 2] = static_cast<uint8_t>(_mm256_extract_epi64(sums, 2));
+            out[i + 3] = static_cast<uint8_t>(_mm256_extract_epi64(sums, 3));
+        }
+        distancesScalar(hash, hashes + i, count - i, out + i);
+    }
+
+    TARGET_AVX512
+    void distancesAvx512(const uint64_t &hash, const uint64_t *hashes, const int &count, uint8_t *out)
+    {
+        const __m512i needle = _mm512_set1_epi64(static_cast<long long>(hash));
+        int i = 0;
+        for(; i+8<=count; i+=8)
+        {
+            const __m512i differentBits = _mm512_xor_si512(_mm512_loadu_si512(hashes + i), needle);
+            const __m128i bytes = _mm512_cvtepi64_epi8(_mm512_popcnt_epi64(differentBits));
+            _mm_storel_epi64(reinterpret_cast<__m128i *>(out + i), bytes);
+        }
+        distancesScalar(hash, hashes + i, count - i, out + i);
+    }
+#endif
+
+    struct Dispatch
+    {
+        Kernel kernel = distancesScalar;
+        const char *name = "scalar";
+
+        Dispatch()
+        {
+#if defined(PHASH_X86) && defined(_MSC_VER) && !defined(__clang__)
+            int info[4];
+            __cpuid(info, 1);
+            const bool osSavesYmm = (info[2] & (1 << 27)) && (_xgetbv(0) & 0x06) == 0x06;
+            const bool osSavesZmm = osSavesYmm && (_xgetbv(0) & 0xe0) == 0xe0;
+            __cpuidex(info, 7, 0);
+            const bool avx2 = osSavesYmm && (info[1] & (1 << 5));
+            const bool avx512 = osSavesZmm && (info[1] & (1 << 16)) && (info[2] & (1 << 14));
+#elif defined(PHASH_X86)
+            __builtin_cpu_init();
+            const bool avx2 = __builtin_cpu_supports("avx2");
+            const bool avx512 = __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512vpopcntdq");
+#endif
+#ifdef PHASH_X86
+            if(avx512)
+            {
+                kernel = distancesAvx512;
+                name = "AVX-512";
+            }
+            else if(avx2)
+            {
+                kernel = distancesAvx2;
+                name = "AVX2";
+            }
+#endif
+        }
+    };
+
+    const Dispatch &dispatch()
+    {
+        static const Dispatch selected;
+        return selected;
+    }
+}
+
+void PhashKernel::distances(const uint64_t &hash, const uint64_t *hashes, const int &count, uint8_t *out)
+{
+    dispatch().kernel(hash, hashes, count, out);
+}
+
+const char *PhashKernel::instructionSet()
+{
+    return dispatch().name;
+}
@@ -0,0 +1,36 @@
+#ifndef PHASHKERNEL_H
+#define PHASHKERNEL_H
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+
+//allocates arrays starting at a cache line, so vector loads never straddle two lines
+template <typename T, std::size_t Alignment = 64>
+struct AlignedAllocator
+{
+    using value_type = T;
+    template <typename U> struct rebind { using other = AlignedAllocator<U, Alignment>; };
+
+    AlignedAllocator() = default;
+    template <typename U> AlignedAllocator(const AlignedAllocator<U, Alignment> &) { }
+
+    T *allocate(const std::size_t n) { return static_cast<T *>(::operator new(n * sizeof(T), std::align_val_t(Alignment))); }
+    void deallocate(T *p, const std::size_t) { ::operator delete(p, std::align_val_t(Alignment)); }
+
+    bool operator==(const AlignedAllocator &) const { return true; }
+    bool operator!=(const AlignedAllocator &) const { return false; }
+};
+
+//counts differing bits between one pHash and a contiguous array of pHashes. uses AVX-512 (VPOPCNTDQ) or AVX2 if
+//processor supports them, chosen once at startup, else hardware popcount one hash at a time
+namespace PhashKernel
+{
+    //out[i] = number of bits that differ between hash and hashes[i]
+    void distances(const uint64_t &hash, const uint64_t *hashes, const int &count, uint8_t *out);
+
+    //instruction set used by distances()
+    const char *instructionSet();
+}
+
+#endif // PHASHKERNEL_H
@@ -7,10 +7,13 @@ class Prefs
 {
 public:
     enum _modes { _PHASH, _SSIM };
+    enum _captureModes { _OPENCV, _FFMPEG, _PIPE };
 
     class MainWindow *_mainwPtr = nullptr;               //pointer to MainWindow, for connecting signals to it's slots
 
     int _comparisonMode = _PHASH;
+    int _captureMode = _OPENCV;
+    bool _keyframeSeek = false;
     int _thumbnails = thumb12;
     int _numberOfVideos = 0;
     int _ssimBlockSize = 16;
@@ -24,6 +27,9 @@ public:
     int _differentDurationModifier = 4;
     int _sameDurationModifier = 1;
     int _cacheLoadPageSize = 300;
+    int _cacheSizeLimit = 0;                            //MB, 0 = no limit
+    bool _contentIds = false;                           //identify videos by sampled content instead of filename
+    bool _skipUnchangedFolders = false;                 //reuse folder listings from cache if folder was not modified
 };
 
 #endif // PREFS_H
@@ -4,61 +4,79 @@ https://github.com/ruofeidu/ImageQualityCompare
 Copyright (c) 2018 Ruofei Du (MIT License)
 */
 
-#include "comparison.h"
+#include "matcher.h"
 
-using namespace cv;
+BlockStats BlockStats::of(const uint8_t *gray, const int &blockSize) {
+    BlockStats stats;
+    if(!gray)
+        return stats;
+    stats.blockSize = blockSize;
+    const int nbBlocks = Video::_ssimSize / blockSize;      //per height and per width
+    const double pixels = blockSize * blockSize;
+    stats.mean.reserve(nbBlocks * nbBlocks);
+    stats.variance.reserve(nbBlocks * nbBlocks);
 
-double Comparison::sigma(const Mat &m, const int &i, const int &j, const int &block_size) const {
-    const Mat m_tmp = m(Range(i, i + block_size), Range(j, j + block_size));
-    const Mat m_squared(block_size, block_size, CV_32F);
-
-    multiply(m_tmp, m_tmp, m_squared);
-
-    const double avg = mean(m_tmp)[0];          //E(x)
-    const double avg_2 = mean(m_squared)[0];    //E(x*x)
-    const double sd = sqrt(avg_2 - avg * avg);
-
-    return sd;
+    for(int k=0; k<nbBlocks; k++) {
+        for(int l=0; l<nbBlocks; l++) {
+            int sum = 0;
+            int squares = 0;
+            for(int i=k*blockSize; i<(k+1)*blockSize; i++) {
+                const uint8_t *row = gray + i * Video::_ssimSize + l * blockSize;
+                for(int j=0; j<blockSize; j++) {
+                    sum += row[j];
+                    squares += row[j] * row[j];
+                }
+            }
+            const double avg = sum / pixels;                            //E(x)
+            stats.mean << static_cast<float>(avg);
+            stats.variance << static_cast<float>(squares / pixels - avg * avg);    //E(x*x) - E(x)E(x)
+        }
+    }
+    return stats;
 }
 
-double Comparison::covariance(const Mat &m0, const Mat &m1, const int &i, const int &j, const int &block_size) const {
-    const Mat m3 = Mat::zeros(block_size, block_size, CV_32F);
-    const Mat m0_tmp = m0(Range(i, i + block_size), Range(j, j + block_size));
-    const Mat m1_tmp = m1(Range(i, i + block_size), Range(j, j + block_size));
-
-    multiply(m0_tmp, m1_tmp, m3);
+double Matcher::ssim(const FingerprintStore &store, const int &left, const int &leftHash,
+                     const int &right, const int &rightHash) const {
+    const uint8_t *m0 = store.gray(left, leftHash);
+    const uint8_t *m1 = store.gray(right, rightHash);
+    if(!m0 || !m1)
+        return 0;
+    const float *mean0 = store.mean(left, leftHash);
+    const float *mean1 = store.mean(right, rightHash);
+    const float *variance0 = store.variance(left, leftHash);
+    const float *variance1 = store.variance(right, rightHash);
+    const int block_size = store.blockSize();
 
-    const double avg_ro = mean(m3)[0];              //E(XY)
-    const double avg_r = mean(m0_tmp)[0];           //E(X)
-    const double avg_o = mean(m1_tmp)[0];           //E(Y)
-    const double sd_ro = avg_ro - avg_o * avg_r;    //E(XY) - E(X)E(Y)
-
-    return sd_ro;
-}
-
-double Comparison::ssim(const Mat &m0, const Mat &m1, const int &block_size) const {
     double ssim = 0;
-    const int nbBlockPerHeight = m0.rows / block_size;
-    const int nbBlockPerWidth = m0.cols / block_size;
+    const int nbBlocks = Video::_ssimSize / block_size;     //per height and per width
+    const double pixels = block_size * block_size;
     constexpr double C1 = 0.01 * 255 * 0.01 * 255;
     constexpr double C2 = 0.03 * 255 * 0.03 * 255;
 
-    for(int k=0; k<nbBlockPerHeight; k++) {
-        for(int l=0; l<nbBlockPerWidth; l++) {
-            const int m = k * block_size;
-            const int n = l * block_size;
+    for(int k=0; k<nbBlocks; k++) {
+        int columns[Video::_ssimSize] = { };        //products of pixels summed down each column of this row of blocks
+        for(int i=k*block_size; i<(k+1)*block_size; i++) {
+            const uint8_t *row0 = m0 + i * Video::_ssimSize;
+            const uint8_t *row1 = m1 + i * Video::_ssimSize;
+            for(int j=0; j<Video::_ssimSize; j++)   //whole rows of integers, compiler vectorizes this (SSE/AVX2/NEON)
+                columns[j] += row0[j] * row1[j];
+        }
+
+        for(int l=0; l<nbBlocks; l++) {
+            int products = 0;
+            for(int j=l*block_size; j<(l+1)*block_size; j++)
+                products += columns[j];
 
-            const double avg_o = mean(m0(Range(k, k + block_size), Range(l, l + block_size)))[0];
-            const double avg_r = mean(m1(Range(k, k + block_size), Range(l, l + block_size)))[0];
-            const double sigma_o = sigma(m0, m, n, block_size);
-            const double sigma_r = sigma(m1, m, n, block_size);
-            const double sigma_ro = covariance(m0, m1, m, n, block_size);
+            const int block = k * nbBlocks + l;
+            const double avg_o = mean0[block];
+            const double avg_r = mean1[block];
+            const double sigma_ro = products / pixels - avg_o * avg_r;     //E(XY) - E(X)E(Y)
 
             ssim += ((2 * avg_o * avg_r + C1) * (2 * sigma_ro + C2)) /
-                    ((avg_o * avg_o + avg_r * avg_r + C1) * (sigma_o * sigma_o + sigma_r * sigma_r + C2));
+                    ((avg_o * avg_o + avg_r * avg_r + C1) * (variance0[block] + variance1[block] + C2));
         }
     }
 
-    ssim = ssim / (nbBlockPerHeight * nbBlockPerWidth);
+    ssim = ssim / (nbBlocks * nbBlocks);
     return ssim;
 }
@@ -2,26 +2,26 @@
 #include <QRegularExpression>
 #include "video.h"
 #include "osutils.h"
-#include "mainwindow.h"
+#include "cachewriter.h"
+
+#ifdef HAVE_LIBAV
+extern "C" {
+#include <libavformat/avformat.h>
+#include <libavutil/display.h>
+}
+#endif
 
 Prefs Video::_prefs;
-int Video::_jpegQuality = _okJpegQuality;
 
 Video::Video(const Prefs &prefsParam, const QString &filenameParam, const QDateTime &dateModParam)
     : filename(filenameParam), modified(dateModParam)
 {
     _prefs = prefsParam;
     id = Db::uniqueId(filenameParam, modified, "");
-    if(_prefs._numberOfVideos > _hugeAmountVideos)       //save memory to avoid crash due to 32 bit limit
-        _jpegQuality = _lowJpegQuality;
-
-    connect(this, &Video::rejectVideo, _prefs._mainwPtr, &MainWindow::removeVideo);
-    connect(this, &Video::acceptVideo, _prefs._mainwPtr, &MainWindow::addVideo);
 }
 
-void Video::run()
+bool Video::probe()
 {
-    Db cache(id);
     if(!cachedMetadata)      //check first if video properties are cached
     {
         getMetadata(filename);          //if not, read them with ffmpeg
@@ -32,36 +32,68 @@ void Video::run()
         emit rejectVideo(this,
             QStringLiteral("Reading properties failed. width: %1 height: %2 duration: %3")
                 .arg(width).arg(height).arg(duration));
-        return;
+        return false;
     }
+    return true;
+}
 
-    const Video::ScreenCaptureResult ret = takeScreenCaptures(cache);
+bool Video::capture(QImage &thumbnail)
+{
+    if(cachedFingerprint)           //screen captures are not needed
+        return true;
+
+    const Video::ScreenCaptureResult ret = takeScreenCaptures(Db::forThread(), thumbnail);
     if(ret == Video::ScreenCaptureResult::NoFrame)
     {
         emit rejectVideo(this, "Taking screen captures failed: no frame");
-    }
-    else if (ret == Video::ScreenCaptureResult::Exception)
-    {
-        emit rejectVideo(this, "Taking screen captures failed: cv exception");
+        return false;
     }
     else if (ret == Video::ScreenCaptureResult::ResolutionMismatch)
     {
         emit rejectVideo(this, "Taking screen captures failed: resolution mismatch");
+        return false;
     }
-    else if((_prefs._thumbnails != cutEnds && hash[0] == 0 ) ||
-            (_prefs._thumbnails == cutEnds && hash[0] == 0 && hash[4] == 0))   //all screen captures black
+    return true;
+}
+
+void Video::fingerprint(QImage &thumbnail)
+{
+    const int hashes = _prefs._thumbnails == cutEnds? 16 : 1;    //if cutEnds mode: separate hash for beginning and end
+    if(!cachedFingerprint)
+    {
+        try {
+            processThumbnail(thumbnail, hashes);
+        } catch (const std::exception &e) {
+            emit rejectVideo(this, "Taking screen captures failed: cv exception");
+            return;
+        }
+        CacheWriter::instance().writeFingerprint(*this, Db::fingerprintMode(_prefs._thumbnails, _prefs._keyframeSeek));
+        this->thumbnail.clear();                    //comparison window reads it from cache (or writer) when shown
+    }
+
+    if((_prefs._thumbnails != cutEnds && hash[0] == 0 ) ||
+       (_prefs._thumbnails == cutEnds && hash[0] == 0 && hash[4] == 0))   //all screen captures black
     {
         emit rejectVideo(this, "All screen captures are black");
     }
     else
     {
-        cache.writeMetadata(*this);
+        if(!cachedMetadata)
+            CacheWriter::instance().writeMetadata(*this);
         emit acceptVideo(this);
     }
 }
 
 void Video::getMetadata(const QString &filename)
 {
+#ifdef HAVE_LIBAV
+    if(probeMetadata(filename))         //read properties from container headers, ffmpeg output is only a fallback
+    {
+        size = QFileInfo(filename).size();
+        return;
+    }
+#endif
+
     const QString ffmpegPath = OSUtils::getFullPath(QFileInfo("ffmpeg"));
     if (ffmpegPath.isEmpty())
     {
@@ -154,15 +186,97 @@ void Video::getMetadata(const QString &filename)
     size = videoFile.size();
 }
 
-Video::ScreenCaptureResult Video::takeScreenCaptures(const Db &cache)
+#ifdef HAVE_LIBAV
+bool Video::probeMetadata(const QString &filename)
+{
+    av_log_set_level(AV_LOG_QUIET);
+    AVFormatContext *format = nullptr;
+    if(avformat_open_input(&format, filename.toUtf8().constData(), nullptr, nullptr) < 0)
+        return false;
+    const int videoStream = avformat_find_stream_info(format, nullptr) < 0? -1 :
+                            av_find_best_stream(format, AVMEDIA_TYPE_VIDEO, -1, -1, nullptr, 0);
+    if(videoStream < 0 || format->streams[videoStream]->codecpar->width == 0 || format->duration == AV_NOPTS_VALUE)
+    {
+        avformat_close_input(&format);
+        return false;
+    }
+
+    const AVStream *stream = format->streams[videoStream];
+    const AVCodecParameters *params = stream->codecpar;
+    duration = (format->duration + 5000) / 10000 * 10;         //microseconds, rounded to 1/100 s like ffmpeg prints it
+    bitrate = static_cast<int>(format->bit_rate / 1000);
+    codec = avcodec_get_name(params->codec_id);
+    width = static_cast<short>(params->width);
+    height = static_cast<short>(params->height);
+    if(stream->avg_frame_rate.num && stream->avg_frame_rate.den)
+        framerate = round(av_q2d(stream->avg_frame_rate) * 10) / 10;     //round to one decimal point
+
+    const int32_t *displayMatrix = nullptr;
+#if LIBAVFORMAT_VERSION_INT >= AV_VERSION_INT(60, 15, 100)
+    if(const AVPacketSideData *sideData = av_packet_side_data_get(params->coded_side_data, params->nb_coded_side_data,
+                                                                  AV_PKT_DATA_DISPLAYMATRIX))
+        displayMatrix = reinterpret_cast<const int32_t *>(sideData->data);
+#else
+    displayMatrix = reinterpret_cast<const int32_t *>(av_stream_get_side_data(stream, AV_PKT_DATA_DISPLAYMATRIX, nullptr));
+#endif
+    if(displayMatrix)
+    {
+        const int rotate = qAbs(qRound(av_display_rotation_get(displayMatrix)));
+        if(rotate == 90 || rotate == 270)
+        {
+            const short temp = width;
+            width = height;
+            height = temp;
+        }
+    }
+
+    const int audioStream = av_find_best_stream(format, AVMEDIA_TYPE_AUDIO, -1, videoStream, nullptr, 0);
+    if(audioStream >= 0)                //same format as ffmpeg prints: "aac 48000 Hz stereo 128 kb/s"
+    {
+        const AVCodecParameters *audioParams = format->streams[audioStream]->codecpar;
+        char layout[64] = "";
+#if LIBAVUTIL_VERSION_INT >= AV_VERSION_INT(57, 28, 100)
+        const int channels = audioParams->ch_layout.nb_channels;
+        av_channel_layout_describe(&audioParams->ch_layout, layout, sizeof(layout));
+#else
+        const int channels = audioParams->channels;
+        av_get_channel_layout_string(layout, sizeof(layout), channels, audioParams->channel_layout);
+#endif
+        QString channelLayout = QString::fromLatin1(layout);
+        if(channels == 1)
+            channelLayout = QStringLiteral("mono");
+        else if(channels == 2)
+            channelLayout = QStringLiteral("stereo");
+        audio = QStringLiteral("%1 %2 Hz %3").arg(avcodec_get_name(audioParams->codec_id))
+                                            .arg(audioParams->sample_rate).arg(channelLayout);
+        if(audioParams->bit_rate > 0)
+            audio = QStringLiteral("%1 %2 kb/s").arg(audio).arg(audioParams->bit_rate / 1000);
+    }
+
+    avformat_close_input(&format);
+    return true;
+}
+#endif
+
+Video::ScreenCaptureResult Video::takeScreenCaptures(const Db &cache, QImage &thumbnailImage)
 {
     Thumbnail thumb(_prefs._thumbnails);
-    QImage thumbnailImage(thumb.cols() * width, thumb.rows() * height, QImage::Format_RGB888);
+    thumbnailImage = QImage(thumb.cols() * width, thumb.rows() * height, QImage::Format_RGB888);
     const QVector<int> percentages = thumb.percentages();
     int capture = percentages.count();
     int ofDuration = 100;
 
-    QHash<int, QByteArray> captures = cache.readCaptures(id, percentages);
+    QHash<int, QByteArray> captures = capturesPrefetched? std::move(prefetchedCaptures) :
+                                                          cache.readCaptures(id, percentages, _prefs._keyframeSeek);
+    prefetchedCaptures.clear();
+    capturesPrefetched = false;
+    cv::VideoCapture session;           //in-process capture: file is opened once and seeked to every position
+    bool sessionOpened = false;
+    QHash<int, QImage> piped;           //pipe capture: all uncached frames are read from one ffmpeg process
+    int pipedOfDuration = 0;
+    int captureMode = _prefs._captureMode;
+    if(_prefs._keyframeSeek && captureMode == _prefs._OPENCV)
+        captureMode = _prefs._PIPE;     //opencv always decodes up to exact position, use ffmpeg for keyframes only
 
     while(--capture >= 0)           //screen captures are taken in reverse order so errors are found early
     {
@@ -180,7 +294,32 @@ Video::ScreenCaptureResult Video::takeScreenCaptures(const Db &cache)
         else
         {
             cachedCaptures = false;
-            frame = captureAt(percentages[capture], ofDuration);
+            if(captureMode == _prefs._PIPE)
+            {
+                if(pipedOfDuration != ofDuration)               //(re)run ffmpeg only once for each retry
+                {
+                    QVector<int> uncached;
+                    for(const auto &percent : percentages)
+                        if(captures[percent].isNull())
+                            uncached << percent;
+                    piped = captureAll(uncached, ofDuration);
+                    pipedOfDuration = ofDuration;
+                }
+                frame = piped.take(percentages[capture]);
+            }
+            else if(captureMode == _prefs._OPENCV && !sessionOpened)
+            {
+                sessionOpened = true;
+                try {
+                    session.open(filename.toStdString(), cv::CAP_FFMPEG);
+                } catch (const cv::Exception &e) {
+                    session.release();
+                }
+            }
+            if(session.isOpened())
+                frame = captureAt(session, percentages[capture], ofDuration);
+            if(frame.isNull())                                  //single ffmpeg process is fallback for other modes
+                frame = captureAt(percentages[capture], ofDuration);
             if(frame.isNull())                                  //taking screen capture may fail if video is broken
             {
                 ofDuration = ofDuration - _goBackwardsPercent;
@@ -203,22 +342,15 @@ Video::ScreenCaptureResult Video::takeScreenCaptures(const Db &cache)
         {
             frame = minimizeImage(frame);
             frame.save(&captureBuffer, QByteArrayLiteral("JPG"), _okJpegQuality);
-            cache.writeCapture(id, percentages[capture], cachedImage);
+            CacheWriter::instance().writeCapture(id, percentages[capture], _prefs._keyframeSeek, cachedImage);
         }
     }
-
-    const int hashes = _prefs._thumbnails == cutEnds? 16 : 1;    //if cutEnds mode: separate hash for beginning and end
-    try {
-        processThumbnail(thumbnailImage, hashes);
-    } catch (const std::exception &e) {
-        return ScreenCaptureResult::Exception;
-    }
-
     return ScreenCaptureResult::Success;
 }
 
 void Video::processThumbnail(QImage &thumbnail, const int &hashes)
 {
+    grayThumb.resize(hashes * _ssimSize * _ssimSize);
     for(int h=0; h<hashes; h++)
     {
         QImage image = thumbnail;
@@ -231,13 +363,20 @@ void Video::processThumbnail(QImage &thumbnail, const int &hashes)
         this->hash[h] = computePhash(mat);                           //pHash
 
         cv::resize(mat, mat, cv::Size(_ssimSize, _ssimSize), 0, 0, cv::INTER_AREA);
-        cv::cvtColor(mat, grayThumb[h], cv::COLOR_BGR2GRAY);
-        grayThumb[h].cv::Mat::convertTo(grayThumb[h], CV_32F);    //ssim
+        cv::Mat gray(_ssimSize, _ssimSize, CV_8U, grayThumb.data() + h * _ssimSize * _ssimSize);
+        cv::cvtColor(mat, gray, cv::COLOR_BGR2GRAY);                 //ssim, written straight into grayThumb
     }
 
     thumbnail = minimizeImage(thumbnail);
     QBuffer buffer(&this->thumbnail);
-    thumbnail.save(&buffer, QByteArrayLiteral("JPG"), _jpegQuality);    //save GUI thumbnail as tiny JPEG
+    thumbnail.save(&buffer, QByteArrayLiteral("JPG"), _okJpegQuality);  //save GUI thumbnail as tiny JPEG
+}
+
+const uint8_t *Video::gray(const int &hash) const
+{
+    if(grayThumb.size() < (hash + 1) * _ssimSize * _ssimSize)
+        return nullptr;
+    return reinterpret_cast<const uint8_t *>(grayThumb.constData()) + hash * _ssimSize * _ssimSize;
 }
 
 uint64_t Video::computePhash(const cv::Mat &input) const
@@ -308,6 +447,18 @@ QString Video::msToHHMMSS(const int64_t &time) const
     return QStringLiteral("%1:%2:%3.%4").arg(paddedHours, paddedMinutes, paddedSeconds).arg(msecs);
 }
 
+QStringList Video::seekArguments(const int &percent, const int &ofDuration) const
+{
+    const QString position = msToHHMMSS(duration * (percent * ofDuration) / (100 * 100));
+    if(!_prefs._keyframeSeek)
+        return { QStringLiteral("-ss"), position };
+
+    //ffmpeg seeks to the keyframe before position using the container index, and without accurate seek that keyframe
+    //is the first frame output. no other frames are decoded. captures are cached apart from exact ones (see Db)
+    return { QStringLiteral("-noaccurate_seek"), QStringLiteral("-skip_frame"), QStringLiteral("nokey"),
+             QStringLiteral("-ss"), position };
+}
+
 QImage Video::captureAt(const int &percent, const int &ofDuration) const
 {
     const QTemporaryDir tempDir;
@@ -316,9 +467,9 @@ QImage Video::captureAt(const int &percent, const int &ofDuration) const
 
     const QString screenshot = QStringLiteral("%1/vidupe%2.bmp").arg(tempDir.path()).arg(percent);
     QProcess ffmpeg;
-    const QString ffmpegCommand = QStringLiteral("%1 -ss %2 -i \"%3\" -an -frames:v 1 -pix_fmt rgb24 %4")
+    const QString ffmpegCommand = QStringLiteral("%1 %2 -i \"%3\" -an -frames:v 1 -pix_fmt rgb24 %4")
                                   .arg(OSUtils::getFullPath(QFileInfo("ffmpeg")),
-                                       msToHHMMSS(duration * (percent * ofDuration) / (100 * 100)),
+                                       seekArguments(percent, ofDuration).join(QStringLiteral(" ")),
                                        QDir::toNativeSeparators(filename),
                                        QDir::toNativeSeparators(screenshot));
     ffmpeg.startCommand(ffmpegCommand);
@@ -329,6 +480,75 @@ QImage Video::captureAt(const int &percent, const int &ofDuration) const
     return img;
 }
 
+QHash<int, QImage> Video::captureAll(const QVector<int> &percentages, const int &ofDuration) const
+{
+    QHash<int, QImage> frames;
+    if(percentages.isEmpty())
+        return frames;
+
+    QStringList arguments = { QStringLiteral("-hide_banner"), QStringLiteral("-loglevel"), QStringLiteral("error") };
+    QString filterGraph;
+    QString concatInputs;
+    for(int i=0; i<percentages.count(); i++)        //every position is a separate input seeked with -ss, but
+    {                                               //only the first frame of each is kept and all are concatenated
+        arguments << seekArguments(percentages[i], ofDuration) << QStringLiteral("-i") << QDir::toNativeSeparators(filename);
+        filterGraph += QStringLiteral("[%1:v:0]trim=end_frame=1,setpts=PTS-STARTPTS,scale=%2:%3[v%1];")
+                       .arg(i).arg(width).arg(height);
+        concatInputs += QStringLiteral("[v%1]").arg(i);
+    }
+    filterGraph += QStringLiteral("%1concat=n=%2:v=1:a=0[out]").arg(concatInputs).arg(percentages.count());
+    arguments << QStringLiteral("-filter_complex") << filterGraph << QStringLiteral("-map") << QStringLiteral("[out]")
+              << QStringLiteral("-an") << QStringLiteral("-vsync") << QStringLiteral("passthrough")
+              << QStringLiteral("-f") << QStringLiteral("rawvideo") << QStringLiteral("-pix_fmt") << QStringLiteral("rgb24")
+              << QStringLiteral("pipe:1");
+
+    QProcess ffmpeg;
+    ffmpeg.setStandardErrorFile(QProcess::nullDevice());
+    ffmpeg.start(OSUtils::getFullPath(QFileInfo("ffmpeg")), arguments);
+    if(!ffmpeg.waitForStarted())
+        return frames;
+
+    const qint64 frameSize = static_cast<qint64>(width) * height * 3;   //rgb24 frames have no header or padding
+    int received = 0;
+    while(received < percentages.count())
+    {
+        if(ffmpeg.bytesAvailable() < frameSize)
+        {
+            if(!ffmpeg.waitForReadyRead(10000))         //process ended or timed out before sending all frames
+                break;
+            continue;
+        }
+        const QByteArray raw = ffmpeg.read(frameSize);
+        QImage frame(width, height, QImage::Format_RGB888);
+        for(int y=0; y<height; y++)
+            memcpy(frame.scanLine(y), raw.constData() + y * width * 3, static_cast<size_t>(width) * 3);
+        frames[percentages[received++]] = frame;
+    }
+
+    if(received < percentages.count())             //frames can't be matched to positions if some are missing
+        frames.clear();
+    ffmpeg.kill();
+    ffmpeg.waitForFinished(1000);
+    return frames;
+}
+
+QImage Video::captureAt(cv::VideoCapture &session, const int &percent, const int &ofDuration) const
+{
+    cv::Mat frame;
+    try {
+        session.set(cv::CAP_PROP_POS_MSEC, static_cast<double>(duration * (percent * ofDuration) / (100 * 100)));
+        if(!session.read(frame) || frame.empty())
+            return QImage();
+        if(frame.cols != width || frame.rows != height)     //rotated or odd video, let ffmpeg take this capture
+            return QImage();
+        cv::cvtColor(frame, frame, cv::COLOR_BGR2RGB);
+    } catch (const cv::Exception &e) {
+        return QImage();
+    }
+
+    return QImage(frame.data, frame.cols, frame.rows, static_cast<int>(frame.step), QImage::Format_RGB888).copy();
+}
+
 void Video::getBrightest(const QString &filename)
 {
     const char* videofilename = "StopMoti2001.mpeg";
@@ -2,7 +2,6 @@
 #define VIDEO_H
 
 #include <QDebug>               //generic includes go here as video.h is used by many files
-#include <QRunnable>
 #include <QProcess>
 #include <QBuffer>
 #include <QTemporaryDir>
@@ -13,13 +12,17 @@
 #include "prefs.h"
 #include "db.h"
 
-class Video : public QObject, public QRunnable
+class Video : public QObject
 {
     Q_OBJECT
 
 public:
     Video(const Prefs &prefsParam, const QString &filenameParam, const QDateTime &dateMod);
-    void run();
+
+    //stages of processing a video, which Ingest runs in separate threads. false is returned after rejecting video
+    bool probe();                               //read properties
+    bool capture(QImage &thumbnail);            //take screen captures into thumbnail, unless fingerprint is cached
+    void fingerprint(QImage &thumbnail);        //hash thumbnail, then accept or reject video
 
     QString filename;
     QString id;
@@ -32,13 +35,19 @@ public:
     QString audio;
     short width = 0;
     short height = 0;
-    QByteArray thumbnail;
-    cv::Mat grayThumb [16];
+    QByteArray thumbnail;                           //GUI thumbnail JPEG, only kept until it is handed to CacheWriter
+    static constexpr int _ssimSize = 16;            //larger than 16x16 seems to have slower comparison
+    QByteArray grayThumb;                           //8 bit grayscale pixels for ssim, of each hash after another,
+                                                    //until FingerprintStore takes them over
     uint64_t hash [16] = { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 };
     bool cachedMetadata = false;
     bool cachedCaptures = true;
+    QHash<int, QByteArray> prefetchedCaptures;      //filled by Db::populateCaptures() before video is processed
+    bool capturesPrefetched = false;
+    bool cachedFingerprint = false;                 //hash and grayThumb were read from cache
 
     QImage captureAt(const int &percent, const int &ofDuration=100) const;
+    const uint8_t *gray(const int &hash) const;     //ssim thumbnail of hash, nullptr if there is none
 
 signals:
     void acceptVideo(Video *addMe);
@@ -46,27 +55,27 @@ signals:
 
 private:
     static Prefs _prefs;
-    static int _jpegQuality;
 
-    enum class ScreenCaptureResult { Success, NoFrame, ResolutionMismatch, Exception };
+    enum class ScreenCaptureResult { Success, NoFrame, ResolutionMismatch };
 
     static constexpr int _okJpegQuality      = 60;
-    static constexpr int _lowJpegQuality     = 25;
-    static constexpr int _hugeAmountVideos   = 200000;
     static constexpr int _goBackwardsPercent = 6;       //if capture fails, retry but omit this much from end
     static constexpr int _videoStillUsable   = 90;      //90% of video duration is considered usable
     static constexpr int _thumbnailMaxWidth  = 448;     //small size to save memory and cache space
     static constexpr int _thumbnailMaxHeight = 336;
     static constexpr int _pHashSize          = 32;      //phash generated from 32x32 image
-    static constexpr int _ssimSize           = 16;      //larger than 16x16 seems to have slower comparison
     static constexpr int _almostBlackBitmap  = 1500;    //monochrome thumbnail if less shades of gray than this
 
     uint64_t computePhash(const cv::Mat &input) const;
     QImage minimizeImage(const QImage &image) const;
     QString msToHHMMSS(const int64_t &time) const;
+    QStringList seekArguments(const int &percent, const int &ofDuration) const;
+    QImage captureAt(cv::VideoCapture &session, const int &percent, const int &ofDuration) const;
+    QHash<int, QImage> captureAll(const QVector<int> &percentages, const int &ofDuration) const;
 
     void getMetadata(const QString &filename);
-    ScreenCaptureResult takeScreenCaptures(const Db &cache);
+    bool probeMetadata(const QString &filename);
+    ScreenCaptureResult takeScreenCaptures(const Db &cache, QImage &thumbnailImage);
     void processThumbnail(QImage &thumbnail, const int &hashes);
     void getBrightest(const QString &filename);
 };